@@ -0,0 +1,126 @@
+/**
+* batch.cpp - Read/blur/write pipeline behind blur_par --batch.
+**/
+
+#include "batch.hpp"
+#include "ppm.hpp"
+#include "queue.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <pthread.h>
+#include <sstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace Batch {
+
+namespace {
+
+    // last marks the end of the stream; a failed read travels as an empty image
+    struct Job {
+        const Item* item { nullptr };
+        Matrix image {};
+        bool last { false };
+    };
+
+    using Queue = SpscQueue<Job, queue_depth>;
+
+    struct StageArgs {
+        const std::vector<Item>* items;
+        Queue* queue;
+        int failed { 0 };   // writer: outputs that could not be written
+    };
+
+    void* reader_stage(void* vp)
+    {
+        auto* a { static_cast<StageArgs*>(vp) };
+        PPM::MappedReader reader {};
+        for (const auto& item : *a->items)
+            a->queue->push(Job { &item, reader(item.in), false });
+        a->queue->push(Job { nullptr, Matrix {}, true });
+        return nullptr;
+    }
+
+    void* writer_stage(void* vp)
+    {
+        auto* a { static_cast<StageArgs*>(vp) };
+        PPM::BulkWriter writer {};
+        for (Job job { a->queue->pop() }; !job.last; job = a->queue->pop())
+            if (!writer(job.image, job.item->out))
+                ++a->failed;   // the writer already reported it
+        return nullptr;
+    }
+
+    std::string target(const fs::path& out_dir, const std::string& in, const std::string& out)
+    {
+        if (out.empty()) return (out_dir / fs::path(in).filename()).string();
+        const fs::path p { out };
+        return p.is_absolute() ? out : (out_dir / p).string();
+    }
+
+}
+
+std::vector<Item> collect(const std::string& source, const std::string& out_dir)
+{
+    std::vector<Item> items {};
+    const fs::path dir { out_dir };
+
+    if (fs::is_directory(source)) {
+        for (const auto& entry : fs::directory_iterator(source))
+            if (entry.is_regular_file() && entry.path().extension() == ".ppm")
+                items.push_back(Item { entry.path().string(), target(dir, entry.path().string(), "") });
+        std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.in < b.in; });
+    } else {
+        std::ifstream manifest { source };
+        if (!manifest)
+            throw std::runtime_error { "cannot open manifest " + source };
+
+        std::string line {};
+        while (std::getline(manifest, line)) {
+            std::istringstream fields { line };
+            std::string in {}, out {};
+            if (!(fields >> in) || in[0] == '#') continue;
+            fields >> out;
+            items.push_back(Item { in, target(dir, in, out) });
+        }
+    }
+
+    // Manifest outputs may name subdirectories of out_dir (or anywhere)
+    fs::create_directories(dir);
+    for (const auto& item : items) {
+        const fs::path parent { fs::path(item.out).parent_path() };
+        if (!parent.empty())
+            fs::create_directories(parent);
+    }
+    return items;
+}
+
+int run(const std::vector<Item>& items, const std::function<void(Matrix&)>& fn)
+{
+    Queue loaded {}, blurred {};
+    StageArgs read_args { &items, &loaded, 0 }, write_args { &items, &blurred, 0 };
+
+    pthread_t reader_tid, writer_tid;
+    pthread_create(&reader_tid, nullptr, &reader_stage, &read_args);
+    pthread_create(&writer_tid, nullptr, &writer_stage, &write_args);
+
+    int failed { 0 };
+    for (Job job { loaded.pop() }; !job.last; job = loaded.pop()) {
+        if (job.image.get_x_size() == 0 || job.image.get_y_size() == 0) {
+            ++failed;   // the reader already reported it
+            continue;
+        }
+        fn(job.image);
+        blurred.push(std::move(job));
+    }
+    blurred.push(Job { nullptr, Matrix {}, true });
+
+    pthread_join(reader_tid, nullptr);
+    pthread_join(writer_tid, nullptr);
+    return failed + write_args.failed;
+}
+
+}
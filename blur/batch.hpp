@@ -0,0 +1,42 @@
+/**
+* batch.hpp - Many images through one process: a reader thread, the blur on
+*   the calling thread (engines use the shared worker pool) and a writer
+*   thread, linked by bounded SPSC queues so reading image k+1 and writing
+*   image k-1 overlap with blurring image k. Planes recycle through
+*   PlanePool, so steady state allocates nothing.
+**/
+
+#include "matrix.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#if !defined(BATCH_HPP)
+#define BATCH_HPP
+
+namespace Batch {
+
+struct Item {
+    std::string in;
+    std::string out;
+};
+
+// Images the reader may run ahead of the blur (and the blur of the writer)
+constexpr size_t queue_depth { 2 };
+
+// Directory: every *.ppm in it (sorted), written under out_dir with the same
+// name. Otherwise a manifest with one "input [output]" per line; a missing
+// output means out_dir/<input file name>, a relative one is taken under
+// out_dir. Blank lines and lines starting with # are skipped. out_dir and
+// the directory of every output are created if needed. Throws
+// std::runtime_error on unreadable input or a directory it cannot create.
+std::vector<Item> collect(const std::string& source, const std::string& out_dir);
+
+// Blurs every item in place with fn; returns the number that failed to read
+// or to write
+int run(const std::vector<Item>& items, const std::function<void(Matrix&)>& fn);
+
+}
+
+#endif
@@ -1,31 +1,463 @@
 #include "matrix.hpp"
 #include "ppm.hpp"
 #include "filters.hpp"
+#include "batch.hpp"
+#include "tiled.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <sys/stat.h>
 #include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::string engine = "exact";   // exact | box | iir | fixed
+    int passes         = Filter::Box::min_passes;
+    bool verify        = false;     // compare against the exact engine
+    bool stats         = false;     // per-thread busy time of the exact engine
+    bool batch         = false;     // infile: manifest or directory, outfile: directory
+    bool cascade       = false;     // radius list: derive each blur from the previous one
+    int stream         = 0;         // > 0: out-of-core, output rows per band
+    bool roi           = false;     // blur only region (--roi / --mask)
+    Filter::Region region{};
+    std::string mask{};             // image whose nonzero pixels join the region
+    Filter::ParallelOptions exact{};
+};
+
+// --stream without a band size
+constexpr int default_band = 256;
+
+void usage(char const* prog) {
+    std::cerr << "Usage: " << prog
+              << " [radius] [infile] [outfile] [num_threads] [options]\n"
+              << "  radius may be a list (5,10,15,30): one output per radius, named\n"
+              << "  <outfile stem>_r<radius><ext>, written while the next one is blurred\n"
+              << "  --engine=ENGINE     exact  separable kernel (default)\n"
+              << "                      box    iterated box approximation (exact below radius "
+              << Filter::Box::min_radius << ")\n"
+              << "                      iir    recursive Young-van Vliet Gaussian\n"
+              << "                      fixed  Q14 integer kernel (SSE2/AVX2), observed max abs error "
+              << Filter::Fixed::observed_max_abs_error << "\n"
+              << "  --passes=N          box passes, " << Filter::Box::min_passes << ".." << Filter::Box::max_passes << "\n"
+              << "  --isa=ISA           force exact-kernel ISA: scalar, sse4.1, avx2, avx512\n"
+              << "                      (default: best supported, detected via cpuid)\n"
+              << "  --generic           exact kernel: skip the fixed-radius kernels for radius 1.."
+              << Filter::Kernels::max_hot_radius << "\n"
+              << "  --vertical=MODE     exact-kernel pass 2: rows (default) or strips (column tiles)\n"
+              << "  --fused             exact kernel: fuse both passes over per-thread row bands\n"
+              << "  --low-memory        exact kernel: in place with a (2R+1)-row ring per thread,\n"
+              << "                      no image-sized scratch\n"
+              << "  --schedule=MODE     exact kernel rows: static (default, one stripe per thread)\n"
+              << "                      dynamic (chunks claimed from a shared counter)\n"
+              << "                      or wavefront (bands, vertical starts once its halo is done)\n"
+              << "  --chunk=N           rows per dynamic chunk / wavefront band (default " << Filter::ParallelOptions{}.chunk << ")\n"
+              << "  --stats             print per-thread busy time of the exact kernel\n"
+              << "  --batch             infile is a manifest (\"input [output]\" per line) or a\n"
+              << "                      directory of .ppm files, outfile the output directory;\n"
+              << "                      one process, reading/writing overlapped with blurring\n"
+              << "  --cascade           radius list: blur each radius from the previous output\n"
+              << "                      (Gaussians compose; approximate, see --verify)\n"
+              << "  --stream[=ROWS]     exact kernel, out of core: read, blur and write ROWS rows\n"
+              << "                      at a time (default " << default_band << "); images up to "
+              << PPM::max_stream_dimension << " per side\n"
+              << "  infile and outfile may both be .tiles images (see ./tiles): exact kernel,\n"
+              << "  computed tile by tile from the mapped input\n"
+              << "  --roi=X,Y,W,H       exact kernel: blur only this rectangle (repeatable);\n"
+              << "                      only the tiles it touches are computed\n"
+              << "  --mask=FILE         exact kernel: also blur where FILE (a PPM of the same\n"
+              << "                      size) is nonzero in any channel\n"
+              << "  --verify            report PSNR / max abs error vs. the exact kernel\n";
+}
+
+bool parse_option(char const* arg, Options& opt) {
+    auto value = [arg](char const* key) -> char const* {
+        const size_t n = std::strlen(key);
+        return std::strncmp(arg, key, n) == 0 ? arg + n : nullptr;
+    };
+
+    if (char const* v = value("--engine=")) {
+        opt.engine = v;
+        return opt.engine == "exact" || opt.engine == "box" || opt.engine == "iir" || opt.engine == "fixed";
+    }
+    if (char const* v = value("--passes=")) {
+        opt.passes = std::atoi(v);
+        return opt.passes >= Filter::Box::min_passes && opt.passes <= Filter::Box::max_passes;
+    }
+    if (char const* v = value("--isa=")) {
+        return Filter::Kernels::parse(v, opt.exact.isa);
+    }
+    if (char const* v = value("--vertical=")) {
+        opt.exact.vertical_strips = std::strcmp(v, "strips") == 0;
+        return opt.exact.vertical_strips || std::strcmp(v, "rows") == 0;
+    }
+    if (std::strcmp(arg, "--generic") == 0) {
+        opt.exact.specialize = false;
+        return true;
+    }
+    if (std::strcmp(arg, "--low-memory") == 0) {
+        opt.exact.low_memory = true;
+        return true;
+    }
+    if (std::strcmp(arg, "--fused") == 0) {
+        opt.exact.fused = true;
+        return true;
+    }
+    if (char const* v = value("--schedule=")) {
+        using Schedule = Filter::ParallelOptions::Schedule;
+        if (std::strcmp(v, "static") == 0) opt.exact.schedule = Schedule::stripes;
+        else if (std::strcmp(v, "dynamic") == 0) opt.exact.schedule = Schedule::dynamic;
+        else if (std::strcmp(v, "wavefront") == 0) opt.exact.schedule = Schedule::wavefront;
+        else return false;
+        return true;
+    }
+    if (char const* v = value("--chunk=")) {
+        opt.exact.chunk = std::atoi(v);
+        return opt.exact.chunk >= 1;
+    }
+    if (std::strcmp(arg, "--stats") == 0) {
+        opt.stats = true;
+        return true;
+    }
+    if (std::strcmp(arg, "--batch") == 0) {
+        opt.batch = true;
+        return true;
+    }
+    if (std::strcmp(arg, "--cascade") == 0) {
+        opt.cascade = true;
+        return true;
+    }
+    if (std::strcmp(arg, "--stream") == 0) {
+        opt.stream = default_band;
+        return true;
+    }
+    if (char const* v = value("--stream=")) {
+        opt.stream = std::atoi(v);
+        return opt.stream >= 1;
+    }
+    if (char const* v = value("--roi=")) {
+        Filter::Rect r{};
+        int w = 0, h = 0;
+        if (std::sscanf(v, "%d,%d,%d,%d", &r.x0, &r.y0, &w, &h) != 4 || w < 1 || h < 1) return false;
+        r.x1 = r.x0 + w;
+        r.y1 = r.y0 + h;
+        opt.region.rects.push_back(r);
+        opt.roi = true;
+        return true;
+    }
+    if (char const* v = value("--mask=")) {
+        opt.mask = v;
+        opt.roi = true;
+        return !opt.mask.empty();
+    }
+    if (std::strcmp(arg, "--verify") == 0) {
+        opt.verify = true;
+        return true;
+    }
+    return false;
+}
+
+void run_engine(const Options& opt, const Matrix& m, Matrix& dst, int radius, int threads) {
+    if (opt.engine == "box")
+        Filter::blur_box_approx(m, dst, radius, opt.passes, threads);
+    else if (opt.engine == "iir")
+        Filter::blur_iir(m, dst, radius, threads);
+    else if (opt.engine == "fixed")
+        Filter::blur_fixed(m, dst, radius, threads, opt.exact.isa);
+    else
+        Filter::blur_parallel(m, dst, radius, threads, opt.exact);
+}
+
+// Busy time per thread and max/mean imbalance (1.0 = perfectly even)
+void print_stats(const std::vector<double>& busy) {
+    if (busy.empty()) return;
+    const double total = std::accumulate(busy.begin(), busy.end(), 0.0);
+    const double worst = *std::max_element(busy.begin(), busy.end());
+    for (size_t t = 0; t < busy.size(); ++t)
+        std::cerr << "stats: thread " << t << " busy " << busy[t] * 1e3 << " ms\n";
+    std::cerr << "stats: imbalance " << (total > 0.0 ? worst * busy.size() / total : 1.0) << "\n";
+}
+
+// Lower bound on PSNR the engine promises against the exact kernel
+double psnr_bound(const Options& opt) {
+    if (opt.engine == "box") return Filter::Box::min_psnr;
+    if (opt.engine == "iir") return Filter::IIR::min_psnr;
+    if (opt.engine == "fixed") return Filter::Fixed::min_psnr;
+    return INFINITY;
+}
+
+// Per-pixel error --verify tolerates; for fixed an observed limit, not a proof
+unsigned error_bound(const Options& opt) {
+    if (opt.engine == "fixed") return Filter::Fixed::observed_max_abs_error;
+    if (opt.engine == "exact") return 0;
+    return 255;
+}
+
+// True if both paths name one existing file (hard links and ./x included)
+bool same_file(const std::string& a, const std::string& b) {
+    struct stat sa{}, sb{};
+    return stat(a.c_str(), &sa) == 0 && stat(b.c_str(), &sb) == 0 && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+// "5,10,15" -> {5, 10, 15}; empty if any entry is not a number
+std::vector<int> parse_radii(char const* arg) {
+    std::vector<int> radii{};
+    for (char const* p = arg; ; ++p) {
+        char* end = nullptr;
+        const long r = std::strtol(p, &end, 10);
+        if (end == p || r < 0) return {};
+        radii.push_back(static_cast<int>(r));
+        p = end;
+        if (*p == '\0') return radii;
+        if (*p != ',') return {};
+    }
+}
+
+// --mask file as one byte per pixel, nonzero where any channel is
+bool load_mask(const std::string& path, unsigned W, unsigned H, std::vector<unsigned char>& mask) {
+    const Matrix m = PPM::MappedReader{}(path);
+    if (m.get_x_size() != W || m.get_y_size() != H) {
+        std::cerr << "mask " << path << " is not " << W << "x" << H << "\n";
+        return false;
+    }
+    mask.resize(static_cast<size_t>(W) * H);
+    for (unsigned y = 0; y < H; ++y)
+        for (unsigned x = 0; x < W; ++x)
+            mask[size_t(y) * W + x] = m.r(x, y) | m.g(x, y) | m.b(x, y);
+    return true;
+}
+
+// out.ppm -> out_r15.ppm
+std::string radius_path(const std::string& out, int radius) {
+    const size_t dot   = out.find_last_of('.');
+    const size_t slash = out.find_last_of('/');
+    const std::string tag = "_r" + std::to_string(radius);
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return out + tag;
+    return out.substr(0, dot) + tag + out.substr(dot);
+}
+
+struct WriteArgs {
+    const Matrix* image;
+    std::string path;
+    bool ok;
+};
+
+void* write_image(void* vp) {
+    auto* a = static_cast<WriteArgs*>(vp);
+    a->ok = PPM::BulkWriter{}(*a->image, a->path);
+    return nullptr;
+}
+
+// Several radii from one read; each output is written on its own thread
+// as soon as it is final, overlapping with the next blur.
+int run_scale_space(const Options& opt, const Matrix& m, std::vector<int> radii, const std::string& out, int threads) {
+    std::sort(radii.begin(), radii.end());
+    radii.erase(std::unique(radii.begin(), radii.end()), radii.end());
+
+    std::vector<Matrix> blurred{};
+    std::vector<WriteArgs> writes(radii.size());
+    std::vector<pthread_t> tids(radii.size());
+
+    const Filter::BlurFn blur = [&](const Matrix& src, Matrix& dst, int radius) {
+        run_engine(opt, src, dst, radius, threads);
+    };
+    Filter::blur_scale_space(m, radii, blurred, blur, opt.cascade, [&](size_t i) {
+        writes[i] = WriteArgs{ &blurred[i], radius_path(out, radii[i]), false };
+        pthread_create(&tids[i], nullptr, &write_image, &writes[i]);
+    });
+
+    int status = 0;
+    if (opt.verify) {
+        const double min = std::min(psnr_bound(opt), opt.cascade ? Filter::ScaleSpace::min_psnr : INFINITY);
+        for (size_t i = 0; i < radii.size(); ++i) {
+            Matrix exact{};
+            Filter::blur_parallel(m, exact, radii[i], threads, {});
+            const double p = Filter::psnr(blurred[i], exact);
+            std::cerr << "verify: engine=" << opt.engine << (opt.cascade ? " cascade" : "")
+                      << " radius=" << radii[i]
+                      << " psnr=" << p << " dB (bound " << min << " dB)"
+                      << " max_abs_error=" << Filter::max_abs_error(blurred[i], exact) << "\n";
+            if (p < min) status = 2;
+        }
+    }
+
+    for (auto tid : tids) pthread_join(tid, nullptr);
+    for (const auto& w : writes)
+        if (!w.ok && status == 0) status = 1;
+    return status;
+}
+
+}
 
 int main(int argc, char const* argv[])
 {
-    if (argc != 5) {
-        std::cerr << "Usage: " << argv[0]
-                  << " [radius] [infile] [outfile] [num_threads]\n";
+    if (argc < 5) {
+        usage(argv[0]);
         return 1;
     }
 
-    const unsigned radius = static_cast<unsigned>(std::stoul(argv[1]));
+    Options opt{};
+    for (int i = 5; i < argc; ++i) {
+        if (!parse_option(argv[i], opt)) {
+            std::cerr << "Unknown or invalid option: " << argv[i] << "\n";
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    const std::vector<int> radii = parse_radii(argv[1]);
+    if (radii.empty()) {
+        std::cerr << "Invalid radius: " << argv[1] << "\n";
+        usage(argv[0]);
+        return 1;
+    }
+    const unsigned radius = static_cast<unsigned>(radii.front());
     const char*     in    = argv[2];
     const char*     out   = argv[3];
     int threads          = std::atoi(argv[4]);
     if (threads < 1) threads = 1;
 
-    PPM::Reader reader{};
-    PPM::Writer writer{};
+    if (opt.roi && (radii.size() > 1 || opt.batch || opt.verify || opt.engine != "exact")) {
+        std::cerr << "--roi / --mask only run the exact engine on one radius and one image\n";
+        return 1;
+    }
+
+    if (opt.batch) {
+        if (radii.size() > 1) {
+            std::cerr << "a radius list cannot be combined with --batch\n";
+            return 1;
+        }
+        if (opt.verify) {
+            std::cerr << "--verify cannot be combined with --batch\n";
+            return 1;
+        }
+
+        std::vector<Batch::Item> items{};
+        try {
+            items = Batch::collect(in, out);
+        } catch (const std::exception& e) {
+            std::cerr << "batch: " << e.what() << "\n";
+            return 1;
+        }
+
+        // Busy time summed over all images
+        std::vector<double> busy{}, total{};
+        if (opt.stats) opt.exact.busy = &busy;
+
+        const auto start = std::chrono::steady_clock::now();
+        const int failed = Batch::run(items, [&](Matrix& m) {
+            run_engine(opt, m, m, static_cast<int>(radius), threads);
+            total.resize(std::max(total.size(), busy.size()));
+            for (size_t t = 0; t < busy.size(); ++t) total[t] += busy[t];
+        });
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        print_stats(total);
+        std::cerr << "batch: " << items.size() - failed << "/" << items.size()
+                  << " images in " << ms << " ms\n";
+        return failed == 0 ? 0 : 1;
+    }
+
+    if (Tiled::is_tiled(in) || Tiled::is_tiled(out)) {
+        if (!Tiled::is_tiled(in) || !Tiled::is_tiled(out) || radii.size() > 1 || opt.batch || opt.verify || opt.stream > 0
+            || opt.engine != "exact") {
+            std::cerr << ".tiles images run the exact engine on one radius, from one .tiles file to another\n";
+            return 1;
+        }
+        // Creating out truncates it while the input is still mapped
+        if (same_file(in, out)) {
+            std::cerr << ".tiles input and output must be different files\n";
+            return 1;
+        }
+
+        try {
+            Tiled::Image src{};
+            Tiled::Image dst{};
+            src.open(in);
+            std::vector<unsigned char> mask{};
+            if (!opt.mask.empty()) {
+                if (!load_mask(opt.mask, src.get_x_size(), src.get_y_size(), mask)) return 1;
+                opt.region.mask = mask.data();
+            }
+            dst.create(out, src.get_x_size(), src.get_y_size(), src.get_tile_x(), src.get_color_max());
+            Filter::blur_tiled(src, dst, static_cast<int>(radius), threads, opt.exact, opt.roi ? &opt.region : nullptr);
+        } catch (const std::runtime_error& e) {
+            std::cerr << "tiled: " << e.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    if (opt.stream > 0) {
+        if (radii.size() > 1 || opt.batch || opt.verify || opt.roi || opt.engine != "exact") {
+            std::cerr << "--stream only runs the exact engine on one radius and one image\n";
+            return 1;
+        }
+
+        // The writer truncates out before the first row is read
+        if (same_file(in, out)) {
+            std::cerr << "--stream input and output must be different files\n";
+            return 1;
+        }
+
+        PPM::StreamReader reader{};
+        PPM::StreamWriter writer{};
+        if (!reader.open(in) || !writer.open(out, reader.get_x_size(), reader.get_y_size(), reader.get_color_max()))
+            return 1;
+        return Filter::blur_stream(reader, writer, static_cast<int>(radius), threads, opt.stream, opt.exact) ? 0 : 1;
+    }
+
+    PPM::MappedReader reader{};
+    PPM::BulkWriter writer{};
 
     auto m = reader(in);
 
-    auto blurred = Filter::blur_parallel(m, static_cast<int>(radius), threads);
+    if (radii.size() > 1)
+        return run_scale_space(opt, m, radii, out, threads);
+
+    std::vector<double> busy{};
+    if (opt.stats) opt.exact.busy = &busy;
+
+    if (opt.verify) {
+        Matrix exact{};
+        Matrix approx{};
+        Filter::blur_parallel(m, exact, static_cast<int>(radius), threads, {});
+        run_engine(opt, m, approx, static_cast<int>(radius), threads);
+
+        const double p   = Filter::psnr(approx, exact);
+        const double min = psnr_bound(opt);
+        const unsigned err = Filter::max_abs_error(approx, exact);
+        std::cerr << "verify: engine=" << opt.engine
+                  << " psnr=" << p << " dB (bound " << min << " dB)"
+                  << " max_abs_error=" << err << " (bound " << error_bound(opt) << ")\n";
+
+        print_stats(busy);
+        if (!writer(approx, out)) return 1;
+        return p >= min && err <= error_bound(opt) ? 0 : 2;
+    }
+
+    if (opt.roi) {
+        std::vector<unsigned char> mask{};
+        if (!opt.mask.empty()) {
+            if (!load_mask(opt.mask, m.get_x_size(), m.get_y_size(), mask)) return 1;
+            opt.region.mask = mask.data();
+        }
+        // In place: pixels outside the region are never touched
+        Filter::blur_region(m, m, static_cast<int>(radius), threads, opt.region, opt.exact);
+        return writer(m, out) ? 0 : 1;
+    }
+
+    // In place: m is both the source and the destination
+    run_engine(opt, m, m, static_cast<int>(radius), threads);
+    print_stats(busy);
 
-    writer(blurred, out);
-    return 0;
+    return writer(m, out) ? 0 : 1;
 }
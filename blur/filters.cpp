@@ -22,10 +22,10 @@ namespace Filter
         }
     }
 
-    Matrix blur(Matrix m, const int radius)
+    Matrix blur(const Matrix& m, const int radius)
     {
-        Matrix scratch{PPM::max_dimension};
-        auto dst{m};
+        Matrix scratch{m.get_x_size(), m.get_y_size(), 0};
+        Matrix dst{m.get_x_size(), m.get_y_size(), m.get_color_max()};
 
         for (auto x{0}; x < dst.get_x_size(); x++)
         {
@@ -39,7 +39,7 @@ namespace Filter
                 //     return R[y * x_size + x];
                 // }
 
-                auto r{w[0] * dst.r(x, y)}, g{w[0] * dst.g(x, y)}, b{w[0] * dst.b(x, y)}, n{w[0]};
+                auto r{w[0] * m.r(x, y)}, g{w[0] * m.g(x, y)}, b{w[0] * m.b(x, y)}, n{w[0]};
 
                 for (auto wi{1}; wi <= radius; wi++)
                 {
@@ -47,17 +47,17 @@ namespace Filter
                     auto x2{x - wi};
                     if (x2 >= 0)
                     {
-                        r += wc * dst.r(x2, y);
-                        g += wc * dst.g(x2, y);
-                        b += wc * dst.b(x2, y);
+                        r += wc * m.r(x2, y);
+                        g += wc * m.g(x2, y);
+                        b += wc * m.b(x2, y);
                         n += wc;
                     }
                     x2 = x + wi;
-                    if (x2 < dst.get_x_size())
+                    if (x2 < m.get_x_size())
                     {
-                        r += wc * dst.r(x2, y);
-                        g += wc * dst.g(x2, y);
-                        b += wc * dst.b(x2, y);
+                        r += wc * m.r(x2, y);
+                        g += wc * m.g(x2, y);
+                        b += wc * m.b(x2, y);
                         n += wc;
                     }
                 }
@@ -2,11 +2,20 @@
 Author: David Holmqvist <daae19@student.bth.se>
 */
 
+#include "kernels.hpp"
 #include "matrix.hpp"
 
+#include <functional>
+#include <vector>
+
 #if !defined(FILTERS_HPP)
 #define FILTERS_HPP
 
+namespace Parallel { class Pool; }
+namespace PPM { class StreamReader; class StreamWriter; }
+namespace Tiled { class Image; }
+struct ImageView;
+
 namespace Filter
 {
 
@@ -19,9 +28,193 @@ namespace Filter
         void get_weights(int n, double *weights_out);
     }
 
-    Matrix blur(Matrix m, const int radius);
-    // Parallel version used in blur_par.cpp and filters_par.cpp
-    Matrix blur_parallel(Matrix m, int radius, int num_threads);
+    namespace Box
+    {
+        constexpr int min_passes{3};
+        constexpr int max_passes{5};
+        // Three odd box widths cannot follow a Gaussian this narrow (noise
+        // at radius 2 comes out near 19 dB), so smaller radii run the exact
+        // kernel instead; it is cheap there anyway
+        constexpr int min_radius{5};
+        // PSNR floor (dB) vs. blur_parallel; worst seen on data/ and noise for
+        // radius 5..200 and 3..5 passes was 43 dB (max abs error 26)
+        constexpr double min_psnr{40.0};
+
+        double sigma_for_radius(int radius);
+        void get_radii(double sigma, int passes, int *radii_out);
+    }
+
+    namespace IIR
+    {
+        // Young & van Vliet's q(sigma) fit is only valid from sigma 0.5 up
+        constexpr double min_sigma{0.5};
+        // PSNR floor (dB) vs. blur_parallel; worst seen on data/ for radius
+        // 2..200 was 43.9 dB (max abs error 19)
+        constexpr double min_psnr{40.0};
+
+        // y[n] = B x[n] + a1 y[n-1] + a2 y[n-2] + a3 y[n-3] (and mirrored).
+        // M maps the last three causal outputs of a zero-extended line to the
+        // first three anticausal states past its end (Triggs & Sdika 2006).
+        struct Coefficients
+        {
+            double B, a1, a2, a3;
+            double M[3][3];
+        };
+
+        Coefficients get_coefficients(double sigma);
+    }
+
+    namespace Fixed
+    {
+        // Q14 weights (pmaddwd operands are signed 16-bit), Q6 intermediate
+        constexpr int weight_bits{14};
+        constexpr int mid_bits{6};
+        // Empirical, not proven: the largest per-pixel deviation from
+        // blur_parallel seen on data/ and random images (1x50 .. 1600x1200,
+        // radius 1..200), PSNR 47.6 dB. The exact kernel truncates its
+        // horizontal result to u8, this one keeps Q6, so the two can land
+        // on either side of an integer. A bound derived from the Q14
+        // rounding (each weight off by up to 2^-15, the centre absorbing
+        // the sum) grows with the radius and is far looser than this.
+        constexpr unsigned observed_max_abs_error{2};
+        constexpr double min_psnr{45.0};
+    }
+
+    namespace ScaleSpace
+    {
+        // Radius that takes a blur at `from` to one at `to` (to >= from)
+        int step_radius(int from, int to);
+        // PSNR floor (dB) of cascaded vs. direct exact blurs, for chains of
+        // up to 4 radii. Each stage truncates twice (about one level darker
+        // per stage); worst seen on data/ was 38.4 dB (max abs error 10)
+        constexpr double min_psnr{36.0};
+    }
+
+    // Half-open pixel rectangle [x0, x1) x [y0, y1)
+    struct Rect
+    {
+        int x0, y0, x1, y1;
+    };
+
+    // Pixels to blur: the union of rects and the nonzero entries of mask
+    // (x_size * y_size bytes, row-major, optional). Everything else keeps
+    // its source value.
+    struct Region
+    {
+        std::vector<Rect> rects{};
+        const unsigned char* mask{nullptr};
+        // Side of the work tiles for Matrix images (.tiles use their own)
+        int tile{64};
+    };
+
+    // Knobs for blur_parallel; every setting produces the same image
+    struct ParallelOptions
+    {
+        Kernels::Isa isa{Kernels::detect()};
+        // Use the fixed-radius kernels for hot radii (1..max_hot_radius)
+        bool specialize{true};
+        // Pass 2 as row-wise AXPY over L2-sized column strips. Off by default:
+        // the per-row kernels already stream 2R+1 row segments per vector,
+        // strips only pay off once W * (2R + 1) bytes outgrows L2.
+        bool vertical_strips{false};
+        // Fused H+V: each thread keeps its horizontal rows in a band buffer
+        // (O(threads * band) memory) instead of an image-sized scratch
+        bool fused{false};
+        // Low-memory fused variant: per thread only a mirrored ring of 2R+1
+        // horizontal rows (plus an R-row halo) per plane; no scratch at all
+        bool low_memory{false};
+        // Two-pass row scheduling. Rows are independent, so the image never
+        // depends on who computed what.
+        //   stripes:   one contiguous stripe per thread, barrier between passes
+        //   dynamic:   chunks of `chunk` rows claimed from a counter per pass
+        //   wavefront: bands of `chunk` rows; a band's vertical pass starts as
+        //              soon as the horizontal bands under its halo are done
+        enum class Schedule { stripes, dynamic, wavefront };
+        Schedule schedule{Schedule::stripes};
+        int chunk{16};
+        // If set, gets each thread's busy seconds (barrier waits excluded)
+        std::vector<double>* busy{nullptr};
+        // Workers to run on; nullptr means Parallel::Pool::shared(). The
+        // box, IIR and fixed engines take no options and always use the
+        // shared pool.
+        Parallel::Pool* pool{nullptr};
+    };
+
+    Matrix blur(const Matrix& m, const int radius);
+    // Parallel version used in blur_par.cpp; dst may alias m (in-place blur)
+    void blur_parallel(const Matrix& m, Matrix& dst, int radius, int num_threads,
+                       const ParallelOptions& opt = {});
+    // O(1)-per-pixel approximation with iterated box passes (filters_box.cpp)
+    void blur_box_approx(const Matrix& m, Matrix& dst, int radius, int passes, int num_threads);
+    // Recursive Young-van Vliet Gaussian, constant cost per pixel (filters_iir.cpp)
+    void blur_iir(const Matrix& m, Matrix& dst, int radius, int num_threads);
+
+    // Integer (Q14) separable kernel with SSE2/AVX2 paths (filters_fixed.cpp)
+    void blur_fixed(const Matrix& m, Matrix& dst, int radius, int num_threads,
+                    Kernels::Isa isa = Kernels::detect());
+
+    // Any engine, bound to its options: blurs src into dst at radius
+    using BlurFn = std::function<void(const Matrix& src, Matrix& dst, int radius)>;
+    // out[i] = m at radii[i] (ascending); with cascade each one is derived
+    // from out[i - 1] instead of m (filters_scale.cpp). on_ready(i) runs as
+    // soon as out[i] is final, e.g. to start writing it.
+    void blur_scale_space(const Matrix& m, const std::vector<int>& radii, std::vector<Matrix>& out,
+                          const BlurFn& blur, bool cascade, const std::function<void(size_t)>& on_ready = {});
+
+    // blur_parallel on caller-owned planar or interleaved buffers with any
+    // stride, no Matrix and no copy of the image (filters_view.cpp). src and
+    // dst may be the same memory; layouts may differ.
+    void blur_view(const ImageView& src, const ImageView& dst, int radius, int num_threads,
+                   const ParallelOptions& opt = {});
+
+    // Out-of-core blur_parallel: reads `band` rows at a time, carries a
+    // 2R-row halo of horizontal rows between bands and writes each output
+    // band when it is done, so memory follows band * W, not the image
+    // (filters_stream.cpp). Closes out; false if reading or writing failed.
+    bool blur_stream(PPM::StreamReader& in, PPM::StreamWriter& out, int radius, int num_threads, int band,
+                     const ParallelOptions& opt = {});
+
+    // Blur between two .tiles images of the same size, one output tile (plus
+    // an R halo of input) at a time; threads claim tiles. Bit-identical to
+    // blur_parallel (filters_tiled.cpp). in and out must be different files.
+    // With a region only the tiles it touches are blurred, the others are
+    // copied; in and out then need the same tile size.
+    void blur_tiled(const Tiled::Image& in, Tiled::Image& out, int radius, int num_threads,
+                    const ParallelOptions& opt = {}, const Region* region = nullptr);
+    // blur_parallel restricted to a region: only the tiles it touches (plus
+    // an R halo) are computed, threads split them by count. dst may alias m;
+    // in place, pixels outside the region are not touched at all.
+    void blur_region(const Matrix& m, Matrix& dst, int radius, int num_threads, const Region& region,
+                     const ParallelOptions& opt = {});
+
+    // Keeps source, horizontal intermediate and output of one exact blur so
+    // that small edits are re-blurred at O(dirty area * R) instead of
+    // O(image) (filters_incremental.cpp). Matches blur_parallel bit for bit.
+    class IncrementalBlur
+    {
+        int radius;
+        int num_threads;
+        ParallelOptions opt;
+        Matrix source{}, middle{}, output{};
+
+    public:
+        IncrementalBlur(int radius, int num_threads, const ParallelOptions& opt = {});
+
+        // Full blur of src; the three images are kept from here on
+        void reset(const Matrix& src);
+        // src is the edited image: equal to the kept source outside dirty.
+        // Takes the dirty pixels and recomputes what they reach. Before any
+        // reset(), or when src is not the kept source's size, this is a
+        // full reset(src) and dirty is ignored.
+        void update(const Matrix& src, const std::vector<Rect>& dirty);
+
+        const Matrix& get_source() const { return source; }
+        const Matrix& get_output() const { return output; }
+    };
+
+    // Image comparison used by blur_par --verify
+    double psnr(const Matrix& a, const Matrix& b);
+    unsigned max_abs_error(const Matrix& a, const Matrix& b);
 }
 
 #endif
\ No newline at end of file
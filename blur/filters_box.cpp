@@ -0,0 +1,169 @@
+/**
+* filters_box.cpp - Radius-independent Gaussian approximation (iterated box blur)
+*   Each pass is a running-sum box filter, so a pixel costs O(passes) no matter
+*   how large the radius is. Box widths follow the usual "n boxes for sigma"
+*   construction; at the borders every box is renormalized over the in-range
+*   taps, matching how the exact kernel treats edges.
+*   Horizontal passes run per row (threads split rows), vertical passes run
+*   row-wise over column strips (threads split strips) so the sliding sums stay
+*   unit-stride. The horizontal result is truncated to u8 like the exact path.
+*   Below Box::min_radius the boxes are too coarse and the exact kernel runs.
+**/
+
+#include "filters.hpp"
+#include "matrix.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace Filter {
+
+    namespace Box
+    {
+        double sigma_for_radius(int radius)
+        {
+            // w(i) = exp(-(i * max_x / radius)^2 * pi) == exp(-i^2 / (2 sigma^2))
+            return radius / (Gauss::max_x * std::sqrt(2.0 * Gauss::pi));
+        }
+
+        void get_radii(double sigma, int passes, int *radii_out)
+        {
+            const double w_ideal = std::sqrt(12.0 * sigma * sigma / passes + 1.0);
+            int wl = static_cast<int>(std::floor(w_ideal));
+            if (wl % 2 == 0) --wl;
+            if (wl < 1) wl = 1;
+            const int wu = wl + 2;
+
+            const double m_ideal = (12.0 * sigma * sigma - passes * wl * wl - 4.0 * passes * wl - 3.0 * passes)
+                                 / (-4.0 * wl - 4.0);
+            const int m = static_cast<int>(std::lround(m_ideal));
+
+            for (int i = 0; i < passes; ++i)
+                radii_out[i] = ((i < m ? wl : wu) - 1) / 2;
+        }
+    }
+
+namespace {
+
+    constexpr int strip_width = 64;   // columns per vertical work item
+
+    /** One normalized box pass over n samples spaced `stride` apart.
+    * in/out are distinct; out[i] = mean(in[max(0,i-r) .. min(n-1,i+r)]).
+    **/
+    void box_row(const float* in, float* out, int n, int r)
+    {
+        double acc = 0.0;
+        const int first_hi = std::min(r, n - 1);
+        for (int i = 0; i <= first_hi; ++i) acc += in[i];
+
+        for (int i = 0; i < n; ++i) {
+            const int lo = std::max(0, i - r), hi = std::min(n - 1, i + r);
+            out[i] = static_cast<float>(acc / (hi - lo + 1));
+            if (i + r + 1 < n) acc += in[i + r + 1];
+            if (i - r >= 0)    acc -= in[i - r];
+        }
+    }
+
+    /** Vertical counterpart of box_row over a [H][S] strip, processed a whole
+    * row of S accumulators at a time.
+    **/
+    void box_strip(const float* in, float* out, double* acc, int H, int S, int r)
+    {
+        std::fill(acc, acc + S, 0.0);
+        const int first_hi = std::min(r, H - 1);
+        for (int y = 0; y <= first_hi; ++y)
+            for (int c = 0; c < S; ++c) acc[c] += in[y * S + c];
+
+        for (int y = 0; y < H; ++y) {
+            const int lo = std::max(0, y - r), hi = std::min(H - 1, y + r);
+            const double inv = 1.0 / (hi - lo + 1);
+            float* o = out + y * S;
+            for (int c = 0; c < S; ++c) o[c] = static_cast<float>(acc[c] * inv);
+
+            if (y + r + 1 < H) {
+                const float* add = in + (y + r + 1) * S;
+                for (int c = 0; c < S; ++c) acc[c] += add[c];
+            }
+            if (y - r >= 0) {
+                const float* sub = in + (y - r) * S;
+                for (int c = 0; c < S; ++c) acc[c] -= sub[c];
+            }
+        }
+    }
+
+    inline unsigned char to_u8(float v)
+    {
+        // Truncate like the exact kernel's double -> unsigned char store
+        return static_cast<unsigned char>(std::min(std::max(v, 0.0f), 255.0f));
+    }
+
+}
+
+/** Public entry: iterated box approximation of blur_parallel().
+* - passes:  number of box passes, clamped to [Box::min_passes, Box::max_passes]
+* - dst may alias m, as for blur_parallel().
+*/
+void blur_box_approx(const Matrix& m, Matrix& dst, const int radius, int passes, int num_threads)
+{
+    if (radius < Box::min_radius) {
+        blur_parallel(m, dst, radius, num_threads);
+        return;
+    }
+
+    passes = std::min(std::max(passes, Box::min_passes), Box::max_passes);
+
+    const int W = static_cast<int>(m.get_x_size());
+    const int H = static_cast<int>(m.get_y_size());
+    if (W == 0 || H == 0) return;
+
+    dst.resize_like(m);
+
+    int radii[Box::max_passes]{};
+    Box::get_radii(Box::sigma_for_radius(radius), passes, radii);
+
+    Matrix scratch { m.get_x_size(), m.get_y_size(), 0 };
+
+    // ---- Horizontal passes: rows -> scratch ----
+    Parallel::for_ranges(0, H, num_threads, [&](int y0, int y1) {
+        std::vector<float> a(W), b(W);
+        for (int y = y0; y < y1; ++y) {
+            for (int c = 0; c < 3; ++c) {
+                std::copy(m.row(c, y), m.row(c, y) + W, a.begin());
+                for (int p = 0; p < passes; ++p) {
+                    box_row(a.data(), b.data(), W, radii[p]);
+                    std::swap(a, b);
+                }
+                std::transform(a.begin(), a.end(), scratch.row(c, y), to_u8);
+            }
+        }
+    });
+
+    // ---- Vertical passes: column strips of scratch -> dst ----
+    const int strips = (W + strip_width - 1) / strip_width;
+    Parallel::for_ranges(0, strips, num_threads, [&](int s0, int s1) {
+        std::vector<float> a(static_cast<size_t>(H) * strip_width), b(a.size());
+        std::vector<double> acc(strip_width);
+        for (int s = s0; s < s1; ++s) {
+            const int x0 = s * strip_width;
+            const int S  = std::min(strip_width, W - x0);
+            for (int c = 0; c < 3; ++c) {
+                for (int y = 0; y < H; ++y) {
+                    const unsigned char* row = scratch.row(c, y) + x0;
+                    std::copy(row, row + S, a.begin() + y * S);
+                }
+                for (int p = 0; p < passes; ++p) {
+                    box_strip(a.data(), b.data(), acc.data(), H, S, radii[p]);
+                    std::swap(a, b);
+                }
+                for (int y = 0; y < H; ++y) {
+                    unsigned char* row = dst.row(c, y) + x0;
+                    std::transform(a.begin() + y * S, a.begin() + (y + 1) * S, row, to_u8);
+                }
+            }
+        }
+    });
+}
+
+} // namespace Filter
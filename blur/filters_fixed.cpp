@@ -0,0 +1,280 @@
+/**
+* filters_fixed.cpp - Fixed-point separable Gaussian (integer SIMD)
+*   Weights are divided by the position's normalizer once and quantized to
+*   Q14 (Fixed::weight_bits) so that they sum to exactly 1 << 14; the centre
+*   tap absorbs the rounding. The horizontal pass keeps Q6 (Fixed::mid_bits)
+*   fractions in an int16 plane instead of truncating to u8, the vertical
+*   pass truncates to u8 like the exact kernel.
+*   Symmetric taps are added first (a + b fits int16 in both passes), then
+*   two taps at a time go through pmaddwd: 16 columns per AVX2 vector versus
+*   4 doubles. Q14 rather than Q15 keeps every weight, including a lone
+*   centre tap of 1.0, inside pmaddwd's signed 16-bit operand.
+*   Scalar, SSE2 and AVX2 paths do the same integer math, so every ISA
+*   produces the same image.
+**/
+
+#include "filters.hpp"
+#include "kernels.hpp"
+#include "matrix.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FIXED_HAVE_X86 1
+#endif
+
+namespace Filter {
+
+namespace {
+
+    constexpr int one = 1 << Fixed::weight_bits;
+    constexpr int none = INT32_MIN;     // Term::b of a one-sided tap
+
+    // (sample[x + a] + sample[x + b]) * q, b == none: sample[x + a] * q
+    struct Term {
+        int a, b;
+        int16_t q;
+    };
+
+    /** Q14 terms of the output at pos on a line of n samples, relative to
+    * pos: centre, the offsets present on both sides, then the one-sided
+    * rest. Divided by the same normalizer as the exact kernel.
+    **/
+    std::vector<Term> quantize(int pos, int n, const Kernels::Plan& p, double norm)
+    {
+        const int R = p.radius;
+        const int before = pos, after = n - 1 - pos;
+        const int both = std::min({ R, before, after });
+        const int single = std::min(R, std::max(before, after));
+        const int dir = before > after ? -1 : 1;
+
+        std::vector<Term> terms { Term { 0, none, 0 } };
+        int sum = 0;
+        for (int i = 1; i <= single; ++i) {
+            const auto q = static_cast<int16_t>(std::lround(p.w[i] / norm * one));
+            terms.push_back(i <= both ? Term { -i, i, q } : Term { dir * i, none, q });
+            sum += i <= both ? 2 * q : q;
+        }
+        terms[0].q = static_cast<int16_t>(one - sum);
+        return terms;
+    }
+
+    // Per-column pointers of a term list for one line (zeros for b == none)
+    struct Taps {
+        std::vector<const int16_t*> a, b;
+        std::vector<int16_t> q;
+    };
+
+    void bind_taps(Taps& t, const std::vector<Term>& terms, const int16_t* base, long step, const int16_t* zeros)
+    {
+        t.a.clear();
+        t.b.clear();
+        t.q.clear();
+        for (const auto& term : terms) {
+            t.a.push_back(base + term.a * step);
+            t.b.push_back(term.b == none ? zeros : base + term.b * step);
+            t.q.push_back(term.q);
+        }
+    }
+
+    /** Stores a rounded Q6 sample (horizontal) or a truncated u8 (vertical). */
+    inline void put(int16_t* out, int x, int32_t acc)
+    {
+        out[x] = static_cast<int16_t>((acc + (1 << (Fixed::weight_bits - Fixed::mid_bits - 1)))
+                                      >> (Fixed::weight_bits - Fixed::mid_bits));
+    }
+
+    inline void put(unsigned char* out, int x, int32_t acc)
+    {
+        out[x] = static_cast<unsigned char>(std::min(255, std::max(0, acc >> (Fixed::weight_bits + Fixed::mid_bits))));
+    }
+
+    /** One horizontal border sample straight from its term list. */
+    inline void border_sample(const std::vector<Term>& terms, const int16_t* line, int x, int16_t* out)
+    {
+        int32_t acc = 0;
+        for (const auto& term : terms)
+            acc += term.q * (line[x + term.a] + (term.b == none ? 0 : line[x + term.b]));
+        put(out, x, acc);
+    }
+
+    template <typename Out>
+    void accumulate_scalar(const Taps& t, int x0, int x1, Out* out)
+    {
+        const int n = static_cast<int>(t.q.size());
+        for (int x = x0; x < x1; ++x) {
+            int32_t acc = 0;
+            for (int k = 0; k < n; ++k)
+                acc += t.q[k] * (t.a[k][x] + t.b[k][x]);
+            put(out, x, acc);
+        }
+    }
+
+#if defined(FIXED_HAVE_X86)
+
+    /** ---- SSE2: 8 columns per vector ---- */
+    inline __m128i sum8(const Taps& t, int k, int x)
+    {
+        return _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(t.a[k] + x)),
+                             _mm_loadu_si128(reinterpret_cast<const __m128i*>(t.b[k] + x)));
+    }
+
+    template <typename Out>
+    void accumulate_sse2(const Taps& t, int x0, int x1, Out* out)
+    {
+        constexpr int mid_shift = Fixed::weight_bits - Fixed::mid_bits;
+        const int n = static_cast<int>(t.q.size());
+        const __m128i zero = _mm_setzero_si128();
+
+        int x = x0;
+        for (; x + 8 <= x1; x += 8) {
+            __m128i lo = zero, hi = zero;
+            for (int k = 0; k < n; k += 2) {
+                const __m128i s0 = sum8(t, k, x);
+                const __m128i s1 = k + 1 < n ? sum8(t, k + 1, x) : zero;
+                const int16_t q1 = k + 1 < n ? t.q[k + 1] : 0;
+                const __m128i q = _mm_set1_epi32(static_cast<int32_t>((uint32_t(uint16_t(q1)) << 16) | uint16_t(t.q[k])));
+                lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(s0, s1), q));
+                hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(s0, s1), q));
+            }
+            if constexpr (sizeof(Out) == 2) {
+                const __m128i r = _mm_set1_epi32(1 << (mid_shift - 1));
+                lo = _mm_srai_epi32(_mm_add_epi32(lo, r), mid_shift);
+                hi = _mm_srai_epi32(_mm_add_epi32(hi, r), mid_shift);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_packs_epi32(lo, hi));
+            } else {
+                lo = _mm_srai_epi32(lo, Fixed::weight_bits + Fixed::mid_bits);
+                hi = _mm_srai_epi32(hi, Fixed::weight_bits + Fixed::mid_bits);
+                const __m128i b = _mm_packus_epi16(_mm_packs_epi32(lo, hi), zero);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), b);
+            }
+        }
+        accumulate_scalar(t, x, x1, out);
+    }
+
+    /** ---- AVX2: 16 columns per vector ----
+    * unpacklo/hi work per 128-bit lane and packs undoes exactly that, so
+    * columns come back in order; only the final u8 pack needs a permute.
+    **/
+    __attribute__((target("avx2"))) inline __m256i sum16(const Taps& t, int k, int x)
+    {
+        return _mm256_add_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(t.a[k] + x)),
+                                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(t.b[k] + x)));
+    }
+
+    template <typename Out>
+    __attribute__((target("avx2"))) void accumulate_avx2(const Taps& t, int x0, int x1, Out* out)
+    {
+        constexpr int mid_shift = Fixed::weight_bits - Fixed::mid_bits;
+        const int n = static_cast<int>(t.q.size());
+        const __m256i zero = _mm256_setzero_si256();
+
+        int x = x0;
+        for (; x + 16 <= x1; x += 16) {
+            __m256i lo = zero, hi = zero;
+            for (int k = 0; k < n; k += 2) {
+                const __m256i s0 = sum16(t, k, x);
+                const __m256i s1 = k + 1 < n ? sum16(t, k + 1, x) : zero;
+                const int16_t q1 = k + 1 < n ? t.q[k + 1] : 0;
+                const __m256i q = _mm256_set1_epi32(static_cast<int32_t>((uint32_t(uint16_t(q1)) << 16) | uint16_t(t.q[k])));
+                lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(s0, s1), q));
+                hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(s0, s1), q));
+            }
+            if constexpr (sizeof(Out) == 2) {
+                const __m256i r = _mm256_set1_epi32(1 << (mid_shift - 1));
+                lo = _mm256_srai_epi32(_mm256_add_epi32(lo, r), mid_shift);
+                hi = _mm256_srai_epi32(_mm256_add_epi32(hi, r), mid_shift);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_packs_epi32(lo, hi));
+            } else {
+                lo = _mm256_srai_epi32(lo, Fixed::weight_bits + Fixed::mid_bits);
+                hi = _mm256_srai_epi32(hi, Fixed::weight_bits + Fixed::mid_bits);
+                const __m256i b = _mm256_packus_epi16(_mm256_packs_epi32(lo, hi), zero);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x),
+                                 _mm256_castsi256_si128(_mm256_permute4x64_epi64(b, 0x08)));
+            }
+        }
+        accumulate_scalar(t, x, x1, out);
+    }
+
+#endif
+
+    template <typename Out>
+    void accumulate(Kernels::Isa isa, const Taps& t, int x0, int x1, Out* out)
+    {
+#if defined(FIXED_HAVE_X86)
+        if (isa >= Kernels::Isa::avx2) return accumulate_avx2(t, x0, x1, out);
+        if (isa >= Kernels::Isa::sse41) return accumulate_sse2(t, x0, x1, out);
+#endif
+        accumulate_scalar(t, x0, x1, out);
+    }
+
+}
+
+/** Public entry: Q14 integer version of blur_parallel(), within
+* Fixed::observed_max_abs_error of it on every image tried. dst may alias m.
+*/
+void blur_fixed(const Matrix& m, Matrix& dst, const int radius, int num_threads, Kernels::Isa isa)
+{
+    const int W = static_cast<int>(m.get_x_size());
+    const int H = static_cast<int>(m.get_y_size());
+    if (W == 0 || H == 0) return;
+    if (radius < 1) {
+        blur_parallel(m, dst, radius, num_threads);
+        return;
+    }
+
+    dst.resize_like(m);
+    if (isa > Kernels::detect()) isa = Kernels::detect();
+
+    const Kernels::Plan plan { radius, W, H };
+    const int R = radius;
+    const std::vector<int16_t> zeros(W, 0);
+
+    // Horizontal term lists: one shared by the interior, one per border column
+    const int lo = std::min(R, W), hi = std::max(lo, W - R);
+    std::vector<std::vector<Term>> border(W);
+    for (int x = 0; x < W; ++x)
+        if (x < lo || x >= hi) border[x] = quantize(x, W, plan, plan.norm_x[x]);
+    const std::vector<Term> inner = hi > lo ? quantize(lo, W, plan, plan.norm_x[lo]) : std::vector<Term> {};
+
+    // Q6 horizontal result, one int16 plane per channel
+    const size_t size = static_cast<size_t>(W) * H;
+    std::vector<int16_t> mid(3 * size);
+
+    // ---- Horizontal: u8 rows -> Q6 ----
+    Parallel::for_ranges(0, H, num_threads, [&](int y0, int y1) {
+        std::vector<int16_t> line(W);
+        Taps taps {};
+        for (int y = y0; y < y1; ++y) {
+            for (int c = 0; c < 3; ++c) {
+                int16_t* out = mid.data() + c * size + static_cast<size_t>(y) * W;
+                std::copy(m.row(c, y), m.row(c, y) + W, line.begin());
+                if (hi > lo) {
+                    bind_taps(taps, inner, line.data(), 1, zeros.data());
+                    accumulate(isa, taps, lo, hi, out);
+                }
+                for (int x = 0; x < lo; ++x) border_sample(border[x], line.data(), x, out);
+                for (int x = hi; x < W; ++x) border_sample(border[x], line.data(), x, out);
+            }
+        }
+    });
+
+    // ---- Vertical: Q6 rows -> u8, one term list per output row ----
+    Parallel::for_ranges(0, H, num_threads, [&](int y0, int y1) {
+        Taps taps {};
+        for (int y = y0; y < y1; ++y) {
+            const auto terms = quantize(y, H, plan, plan.norm_y[y]);
+            for (int c = 0; c < 3; ++c) {
+                bind_taps(taps, terms, mid.data() + c * size + static_cast<size_t>(y) * W, W, zeros.data());
+                accumulate(isa, taps, 0, W, dst.row(c, y));
+            }
+        }
+    });
+}
+
+} // namespace Filter
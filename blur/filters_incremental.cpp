@@ -0,0 +1,121 @@
+/**
+* filters_incremental.cpp - Re-blur only what a set of edits can reach
+*   A source pixel (x, y) feeds horizontal-pass pixels (x - R .. x + R, y),
+*   and those feed output pixels within R rows of them. So a dirty rectangle
+*   [x0, x1) x [y0, y1) invalidates the intermediate on rows [y0, y1),
+*   columns [x0 - R, x1 + R), and the output on that column span dilated by
+*   R rows. Both are recomputed in place, O(dirty area * R) work in all.
+*   The horizontal span is blurred from a window that reaches a further R
+*   columns out (or to the image border) with a plan built for that window,
+*   so taps and normalizers match the whole row, as in filters_tiled.cpp.
+*   All horizontal updates run before any vertical one: an output span may
+*   read intermediate rows another rectangle changed.
+**/
+
+#include "filters.hpp"
+#include "matrix.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace Filter {
+
+namespace {
+
+    // Rectangle clipped to W x H and grown by dx columns, dy rows
+    Rect grow(Rect r, int dx, int dy, int W, int H) {
+        return Rect { std::max(0, r.x0 - dx), std::max(0, r.y0 - dy), std::min(W, r.x1 + dx), std::min(H, r.y1 + dy) };
+    }
+
+}
+
+IncrementalBlur::IncrementalBlur(int radius, int num_threads, const ParallelOptions& opt)
+    : radius(radius), num_threads(num_threads), opt(opt) {}
+
+void IncrementalBlur::reset(const Matrix& src) {
+    source = src;
+    const int W = static_cast<int>(src.get_x_size()), H = static_cast<int>(src.get_y_size());
+    if (W == 0 || H == 0) return;
+
+    // Same two passes as blur_parallel, but the intermediate is kept
+    const Kernels::Plan plan { radius, W, H };
+    const Kernels::Dispatch& kernels = opt.specialize ? Kernels::select(opt.isa, radius) : Kernels::select(opt.isa);
+    middle.resize_like(src);
+    output.resize_like(src);
+
+    Parallel::for_ranges(0, H, num_threads, [&](int y0, int y1) {
+        std::vector<double> tmp(W);
+        for (int y = y0; y < y1; ++y)
+            for (int c = 0; c < 3; ++c)
+                kernels.horizontal(source.row(c, y), middle.row(c, y), W, plan, tmp.data());
+    }, opt.pool);
+    const int stride = static_cast<int>(middle.stride());
+    Parallel::for_ranges(0, H, num_threads, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y)
+            for (int c = 0; c < 3; ++c)
+                kernels.vertical(middle.plane(c), stride, y, H, output.row(c, y), W, plan);
+    }, opt.pool);
+}
+
+void IncrementalBlur::update(const Matrix& src, const std::vector<Rect>& dirty) {
+    // Nothing kept to patch (never reset, or a different image)
+    if (src.get_x_size() != source.get_x_size() || src.get_y_size() != source.get_y_size()) {
+        reset(src);
+        return;
+    }
+
+    const int W = static_cast<int>(source.get_x_size()), H = static_cast<int>(source.get_y_size());
+    const int R = radius;
+    if (W == 0 || H == 0) return;
+
+    const Kernels::Plan plan { radius, W, H };
+    const Kernels::Dispatch& kernels = opt.specialize ? Kernels::select(opt.isa, radius) : Kernels::select(opt.isa);
+
+    const int stride = static_cast<int>(middle.stride());
+
+    std::vector<Rect> rects {};
+    for (const Rect& d : dirty) {
+        const Rect r = grow(d, 0, 0, W, H);
+        if (r.x0 < r.x1 && r.y0 < r.y1) rects.push_back(r);
+    }
+
+    // ---- Source: take the edited pixels ----
+    for (const Rect& r : rects)
+        Parallel::for_ranges(r.y0, r.y1, num_threads, [&](int y0, int y1) {
+            for (int y = y0; y < y1; ++y)
+                for (int c = 0; c < 3; ++c)
+                    std::memcpy(source.row(c, y) + r.x0, src.row(c, y) + r.x0, r.x1 - r.x0);
+        }, opt.pool);
+
+    // ---- Horizontal: columns [x0 - R, x1 + R) of the dirty rows ----
+    for (const Rect& r : rects) {
+        const Rect span = grow(r, R, 0, W, H);
+        const Rect window = grow(r, 2 * R, 0, W, H);
+        const int w = window.x1 - window.x0;
+        const Kernels::Plan local { radius, w, 1 };
+
+        Parallel::for_ranges(r.y0, r.y1, num_threads, [&](int y0, int y1) {
+            std::vector<double> tmp(w);
+            std::vector<unsigned char> row(w);
+            for (int y = y0; y < y1; ++y)
+                for (int c = 0; c < 3; ++c) {
+                    kernels.horizontal(source.row(c, y) + window.x0, row.data(), w, local, tmp.data());
+                    std::memcpy(middle.row(c, y) + span.x0, row.data() + (span.x0 - window.x0), span.x1 - span.x0);
+                }
+        }, opt.pool);
+    }
+
+    // ---- Vertical: the same columns, R more rows either side ----
+    for (const Rect& r : rects) {
+        const Rect span = grow(r, R, R, W, H);
+        Parallel::for_ranges(span.y0, span.y1, num_threads, [&](int y0, int y1) {
+            for (int y = y0; y < y1; ++y)
+                for (int c = 0; c < 3; ++c)
+                    kernels.vertical(middle.plane(c) + span.x0, stride, y, H, output.row(c, y) + span.x0, span.x1 - span.x0, plan);
+        }, opt.pool);
+    }
+}
+
+}
@@ -1,17 +1,39 @@
 /**
 * filters_opt.cpp - Parallel, two-pass (seperable) Gaussian blur with pthreads
 *   Threading: Rows are split across threads; each thread owns a [y0, y1] stripe.
-*   Cache locality: Iterate x->y; Compute Gaussian weights once per thread.
+*              Both passes run in one dispatch on a persistent pool
+*              (parallel.hpp), separated by its reusable barrier.
+*              Dynamic mode instead claims chunks of rows from an atomic
+*              counter per pass, so slow or preempted cores take fewer.
+*              Wavefront mode drops the barrier: bands are tracked and a
+*              vertical band runs once its halo rows are horizontally done.
+*   Kernels: per-plane row kernels from kernels.cpp (scalar reference or
+*            SSE4.1/AVX2/AVX-512, picked via cpuid); weights and edge
+*            normalizers are computed once per call.
+*   Fused mode: no image-sized scratch; each thread slides a band of
+*            horizontal rows (plus 2R halo) through a private buffer and
+*            runs the vertical kernel on it right away.
+*   Low-memory mode: the same with a ring of 2R+1 rows, stored twice so
+*            any 2R+1 consecutive rows are contiguous for the row kernels.
 *   Correctness: Passes verify.sh and identical to the sequential version. 
 **/
 
 #include "filters.hpp"
+#include "kernels.hpp"
 #include "matrix.hpp"
+#include "parallel.hpp"
 #include "ppm.hpp"
 
-#include <pthread.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <thread>
 #include <vector>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 
 namespace Filter {
 
@@ -28,152 +50,394 @@ namespace Filter {
     }
 
 struct PassArgs {
-    Matrix* dst;        // final image (read in pass1, written in pass2)
+    const Matrix* src;  // source image (read in pass1)
+    Matrix* dst;        // final image (written in pass2, may alias src)
     Matrix* scratch;    // intermediate buffer (written in pass1, read in pass2)
-    int radius;
+    const Kernels::Plan* plan;          // weights + normalizers, shared
+    const Kernels::Dispatch* kernels;   // row kernels for the selected ISA
+    bool strips;                        // pass 2 over column strips
+    double* acc;                        // strips: this thread's plan.strip accumulators
     int W, H;
     int y0, y1;        
+    int band;                           // fused: output rows per band
+    Parallel::Barrier* barrier;         // between passes / fused halo reads
 };
 
+// Fused mode: per-thread budget for the three band buffers (L2-sized)
+constexpr size_t fused_bytes = 1u << 20;
+
+/** Vertical blur of rows [y0, y1) of plane c into dst; src (rows `stride`
+*   bytes apart) is indexed by absolute row. */
+static void vertical_rows(const PassArgs* a, const unsigned char* src, size_t stride, int c, int y0, int y1) {
+    const Kernels::Plan& plan = *a->plan;
+    const int W = a->W, H = a->H;
+
+    if (a->strips) {
+        for (int x0 = 0; x0 < W; x0 += plan.strip) {
+            const int x1 = std::min(W, x0 + plan.strip);
+            for (int y = y0; y < y1; ++y)
+                a->kernels->vertical_strip(src, int(stride), y, H, a->dst->row(c, y), x0, x1, plan, a->acc);
+        }
+        return;
+    }
+    for (int y = y0; y < y1; ++y)
+        a->kernels->vertical(src, int(stride), y, H, a->dst->row(c, y), W, plan);
+}
+
 /** ---- Pass 1: horizontal blur into scratch --------------------------------
-* For each pixel (x,y), average along X using precomputed weights.
-* Reads from dst (source), writes to scratch (horizontal result).
+* For each row and plane, average along X using the shared plan.
+* Reads from src, writes to scratch (horizontal result).
 *   --------------------------------------------------------------------------
 **/
 static void* pass1_worker(void* vp) {
     auto* a = static_cast<PassArgs*>(vp);
-    Matrix& dst     = *a->dst;
-    Matrix& scratch = *a->scratch;
-    const int R = a->radius, W = a->W;
+    const Kernels::Plan& plan = *a->plan;
+    const int W = a->W;
 
-    // O1: compute weights once per thread (not per pixel)
-    double w[Gauss::max_radius]{};
-    Gauss::get_weights(R, w);
+    std::vector<double> tmp(W);   // row widened to double for SIMD kernels
 
     for (int y = a->y0; y < a->y1; ++y) { // each thread handles a range of rows
-        for (int x = 0; x < W; ++x) { // O2: iterate x→y for better cache locality
-            auto r = w[0] * dst.r(x, y);
-            auto g = w[0] * dst.g(x, y);
-            auto b = w[0] * dst.b(x, y);
-            auto n = w[0];
-
-            for (int wi = 1; wi <= R; ++wi) {
-                const double wc = w[wi];
-                int x2 = x - wi;
-                if (x2 >= 0) {
-                    r += wc * dst.r(x2, y);
-                    g += wc * dst.g(x2, y);
-                    b += wc * dst.b(x2, y);
-                    n += wc;
-                }
-                x2 = x + wi;
-                if (x2 < W) {
-                    r += wc * dst.r(x2, y);
-                    g += wc * dst.g(x2, y);
-                    b += wc * dst.b(x2, y);
-                    n += wc;
-                }
-            }
-
-            scratch.r(x, y) = r / n;
-            scratch.g(x, y) = g / n;
-            scratch.b(x, y) = b / n;
-        }
+        for (int c = 0; c < 3; ++c)
+            a->kernels->horizontal(a->src->row(c, y), a->scratch->row(c, y), W, plan, tmp.data());
     }
     return nullptr;
 }
 
 /** ---- Pass 2: vertical blur from scratch into dst --------------------------
-*        For each pixel (x,y), average along Y using same weights.
+*        For each row and plane, average along Y using the same plan.
 *        Reads from scratch (horizontal result), writes final to dst.
+*        Strip mode tiles the columns (plan.strip wide) and walks the stripe
+*        rows inside each tile, so the 2R+1 source row segments stay in L2
+*        and are accumulated row-wise instead of re-read per pixel.
 **/
 static void* pass2_worker(void* vp) {
     auto* a = static_cast<PassArgs*>(vp);
-    Matrix& dst     = *a->dst;
-    Matrix& scratch = *a->scratch;
-    const int R = a->radius, W = a->W, H = a->H;
+    const Kernels::Plan& plan = *a->plan;
+    const int W = a->W, H = a->H;
+
+    const Matrix& src = *a->scratch;
+    const int stride = static_cast<int>(src.stride());
 
-    // O1: compute weights once per thread (not per pixel)
-    double w[Gauss::max_radius]{};
-    Gauss::get_weights(R, w);
+    if (a->strips) {
+        for (int c = 0; c < 3; ++c)
+            vertical_rows(a, src.plane(c), src.stride(), c, a->y0, a->y1);
+        return nullptr;
+    }
 
     for (int y = a->y0; y < a->y1; ++y) { // each thread handles a range of rows
-        for (int x = 0; x < W; ++x) { // O2: iterate x→y for better cache locality
-            auto r = w[0] * scratch.r(x, y);
-            auto g = w[0] * scratch.g(x, y);
-            auto b = w[0] * scratch.b(x, y);
-            auto n = w[0];
-
-            for (int wi = 1; wi <= R; ++wi) {
-                const double wc = w[wi];
-                int y2 = y - wi;
-                if (y2 >= 0) {
-                    r += wc * scratch.r(x, y2);
-                    g += wc * scratch.g(x, y2);
-                    b += wc * scratch.b(x, y2);
-                    n += wc;
-                }
-                y2 = y + wi;
-                if (y2 < H) {
-                    r += wc * scratch.r(x, y2);
-                    g += wc * scratch.g(x, y2);
-                    b += wc * scratch.b(x, y2);
-                    n += wc;
-                }
+        for (int c = 0; c < 3; ++c)
+            a->kernels->vertical(src.plane(c), stride, y, H, a->dst->row(c, y), W, plan);
+    }
+    return nullptr;
+}
+
+/** ---- Fused: horizontal rows into a sliding band, vertical straight after ---
+*        The buffer holds band + 2R horizontal rows per plane, addressed by
+*        absolute row through base. When the next band does not fit, the
+*        rows still needed (from y - R) slide to the front.
+*        Rows outside [y0, y1) are outputs of other threads and dst may
+*        alias src, so they are taken before the barrier: the leading halo
+*        straight into the band, the trailing one into tail.
+**/
+static void* fused_worker(void* vp) {
+    auto* a = static_cast<PassArgs*>(vp);
+    const Kernels::Plan& plan = *a->plan;
+    const int W = a->W, H = a->H, R = plan.radius;
+    const int y0 = a->y0, y1 = a->y1;
+    const int lo = std::max(0, y0 - R), hi = std::min(H, y1 + R);
+    const int rows = a->band + 2 * R;
+
+    const Matrix& src = *a->src;
+    std::vector<unsigned char> buf(3 * size_t(rows) * W);
+    std::vector<unsigned char> tail(3 * size_t(hi - y1) * W);
+    std::vector<double> tmp(W);
+
+    unsigned char* band[3] = { buf.data(), buf.data() + size_t(rows) * W, buf.data() + 2 * size_t(rows) * W };
+    unsigned char* after[3] = { tail.data(), tail.data() + size_t(hi - y1) * W, tail.data() + 2 * size_t(hi - y1) * W };
+
+    for (int c = 0; c < 3; ++c) {
+        for (int y = lo; y < y0; ++y)
+            a->kernels->horizontal(src.row(c, y), band[c] + (y - lo) * W, W, plan, tmp.data());
+        for (int y = y1; y < hi; ++y)
+            a->kernels->horizontal(src.row(c, y), after[c] + (y - y1) * W, W, plan, tmp.data());
+    }
+    a->barrier->wait();
+
+    int base = lo, have = y0;   // band rows [base, have) are filled
+    for (int y = y0; y < y1; y += a->band) {
+        const int ye = std::min(y1, y + a->band);
+        const int need = std::min(H, ye + R);
+
+        if (need - base > rows) {
+            const int keep = std::max(0, y - R);
+            for (int c = 0; c < 3; ++c)
+                std::memmove(band[c], band[c] + size_t(keep - base) * W, size_t(have - keep) * W);
+            base = keep;
+        }
+        for (; have < need; ++have)
+            for (int c = 0; c < 3; ++c) {
+                unsigned char* row = band[c] + size_t(have - base) * W;
+                if (have < y1)
+                    a->kernels->horizontal(src.row(c, have), row, W, plan, tmp.data());
+                else
+                    std::memcpy(row, after[c] + size_t(have - y1) * W, W);
             }
+        // Kernels only touch rows [y - R, ye + R) clamped to the image,
+        // all of which sit in the band
+        for (int c = 0; c < 3; ++c)
+            vertical_rows(a, band[c] - size_t(base) * W, W, c, y, ye);
+    }
+    return nullptr;
+}
+
+/** ---- Low memory: fused over a mirrored ring of 2R+1 horizontal rows -------
+*        Row r lives in slot r % (2R+1) and again 2R+1 slots later, so the
+*        rows [y - R, y + R] any output needs always form one contiguous
+*        window of the buffer, which the unchanged vertical kernels read
+*        with stride W. The extra copy per row is W bytes against the
+*        (2R+1) W multiply-adds it feeds. Halo handling as in fused_worker.
+**/
+static void* ring_worker(void* vp) {
+    auto* a = static_cast<PassArgs*>(vp);
+    const Kernels::Plan& plan = *a->plan;
+    const int W = a->W, H = a->H, R = plan.radius;
+    const int y0 = a->y0, y1 = a->y1;
+    const int lo = std::max(0, y0 - R), hi = std::min(H, y1 + R);
+    const int slots = 2 * R + 1;
 
-            dst.r(x, y) = r / n;
-            dst.g(x, y) = g / n;
-            dst.b(x, y) = b / n;
+    const Matrix& src = *a->src;
+    std::vector<unsigned char> buf(3 * 2 * size_t(slots) * W);
+    std::vector<unsigned char> tail(3 * size_t(hi - y1) * W);
+    std::vector<double> tmp(W);
+
+    auto ring = [&](int c) { return buf.data() + c * 2 * size_t(slots) * W; };
+    auto after = [&](int c) { return tail.data() + c * size_t(hi - y1) * W; };
+    auto put = [&](int c, int r, const unsigned char* from) {
+        unsigned char* row = ring(c) + size_t(r % slots) * W;
+        if (from)
+            std::memcpy(row, from, W);
+        else
+            a->kernels->horizontal(src.row(c, r), row, W, plan, tmp.data());
+        std::memcpy(row + size_t(slots) * W, row, W);
+    };
+
+    for (int c = 0; c < 3; ++c) {
+        for (int r = lo; r < y0; ++r) put(c, r, nullptr);
+        for (int r = y1; r < hi; ++r)
+            a->kernels->horizontal(src.row(c, r), after(c) + (r - y1) * W, W, plan, tmp.data());
+    }
+    a->barrier->wait();
+
+    int have = y0;      // rows [max(lo, have - slots), have) are in the ring
+    for (int y = y0; y < y1; ++y) {
+        for (const int need = std::min(H, y + R + 1); have < need; ++have)
+            for (int c = 0; c < 3; ++c)
+                put(c, have, have < y1 ? nullptr : after(c) + size_t(have - y1) * W);
+
+        // Window starts at the first row the kernel reads; address rows absolutely
+        const int first = std::max(0, y - R);
+        for (int c = 0; c < 3; ++c) {
+            const unsigned char* window = ring(c) + size_t(first % slots) * W;
+            vertical_rows(a, window - size_t(first) * W, W, c, y, y + 1);
         }
     }
     return nullptr;
 }
 
+/** Dynamic scheduling: claim `chunk` rows at a time until the pass runs dry. */
+static void claim_rows(PassArgs a, std::atomic<int>& next, int chunk, void* (*pass)(void*)) {
+    for (;;) {
+        const int y = next.fetch_add(chunk, std::memory_order_relaxed);
+        if (y >= a.H) return;
+        a.y0 = y;
+        a.y1 = std::min(a.H, y + chunk);
+        pass(&a);
+    }
+}
+
+/** ---- Wavefront: both passes over bands, no global barrier ----------------
+*        Horizontal and vertical bands are each claimed in order. A thread
+*        takes the next vertical band when every horizontal band under its
+*        halo [y0 - R, y1 + R) is done, else the next horizontal band, else
+*        yields until a straggler finishes. Vertical band v writes dst rows
+*        that only horizontal band v reads, and it waits for that band, so
+*        dst may alias src here as well.
+**/
+struct Wavefront {
+    int bands, band, R;
+    std::atomic<int> next_h{0}, next_v{0};
+    std::unique_ptr<std::atomic<bool>[]> h_done;
+
+    Wavefront(int H, int band, int R)
+        : bands{(H + band - 1) / band}, band{band}, R{R}, h_done{new std::atomic<bool>[bands]}
+    {
+        for (int b = 0; b < bands; ++b) h_done[b].store(false, std::memory_order_relaxed);
+    }
+
+    bool ready(int v) const {
+        const int first = std::max(0, v * band - R) / band;
+        const int last  = std::min(bands - 1, ((v + 1) * band + R - 1) / band);
+        for (int b = first; b <= last; ++b)
+            if (!h_done[b].load(std::memory_order_acquire)) return false;
+        return true;
+    }
+};
+
+static void wavefront_worker(PassArgs a, Wavefront& wf, double* busy) {
+    auto run = [&](int b, void* (*pass)(void*)) {
+        const auto start = std::chrono::steady_clock::now();
+        a.y0 = b * wf.band;
+        a.y1 = std::min(a.H, a.y0 + wf.band);
+        pass(&a);
+        if (busy) *busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    for (;;) {
+        int v = wf.next_v.load(std::memory_order_relaxed);
+        if (v >= wf.bands) return;
+        if (wf.ready(v)) {
+            if (wf.next_v.compare_exchange_weak(v, v + 1, std::memory_order_relaxed))
+                run(v, &pass2_worker);
+            continue;
+        }
+        int h = wf.next_h.load(std::memory_order_relaxed);
+        if (h < wf.bands) {
+            if (wf.next_h.compare_exchange_weak(h, h + 1, std::memory_order_relaxed)) {
+                run(h, &pass1_worker);
+                wf.h_done[h].store(true, std::memory_order_release);
+            }
+            continue;
+        }
+        std::this_thread::yield();
+    }
+}
+
 /** Public entry used by blur_par: same math as sequential blur(), but threaded.
-* - m:       input image (copied into dst)
+* - m:       input image
+* - dst:     output image; (re)allocated only if its shape differs from m.
+*            May be m itself: pass 2 only starts after pass 1 has consumed m.
 * - radius:  blur radius (<= Gauss::max_radius - 1)
 * - threads: number of worker threads (clamped to [1..H])
-* Returns blurred image in dst
+* - opt:     kernel ISA (defaults to the best one cpuid reports), pass 2
+*            layout, fused / low-memory mode, row scheduling and busy-time reporting
 */
-Matrix blur_parallel(Matrix m, const int radius, int num_threads) {
+void blur_parallel(const Matrix& m, Matrix& dst, const int radius, int num_threads, const ParallelOptions& opt) {
     if (num_threads < 1) num_threads = 1;
 
-    Matrix dst = m;                      
-    Matrix scratch { PPM::max_dimension };
-
-    const int W = static_cast<int>(dst.get_x_size());
-    const int H = static_cast<int>(dst.get_y_size());
+    const int W = static_cast<int>(m.get_x_size());
+    const int H = static_cast<int>(m.get_y_size());
     if (num_threads > H) num_threads = H;
+    if (H == 0) return;
+
+    dst.resize_like(m);
+
+    // O1: weights and edge normalizers once per call (not per pixel/thread)
+    const Kernels::Plan plan { radius, W, H };
+    const Kernels::Dispatch& kernels = opt.specialize ? Kernels::select(opt.isa, radius) : Kernels::select(opt.isa);
+
+    Parallel::Pool& pool = opt.pool ? *opt.pool : Parallel::Pool::shared(num_threads);
+    if (num_threads > pool.size()) num_threads = pool.size();
+
+    // Right-sized, recycled through PlanePool across calls; fused mode
+    // keeps its horizontal rows per thread instead
+    Matrix scratch {};
+    if (!opt.fused && !opt.low_memory) scratch = Matrix { m.get_x_size(), m.get_y_size(), 0 };
+    const int band = std::max(16, static_cast<int>(fused_bytes / (3 * size_t(W))) - 2 * radius);
+
+    // Strip accumulators, one slice per thread, reused by every row it blurs
+    std::vector<double> acc(opt.vertical_strips ? size_t(num_threads) * plan.strip : 0);
 
     // Partition rows as evenly as possible
-    std::vector<pthread_t> tids(num_threads);
-    std::vector<PassArgs>  args(num_threads);
+    std::vector<PassArgs> args(num_threads);
 
     const int rows_per = H / num_threads;
     const int extra    = H % num_threads;
 
-    // ---- Pass 1 (horizontal) ----
     int ycur = 0;
     for (int t = 0; t < num_threads; ++t) {
         const int take = rows_per + (t < extra ? 1 : 0);
-        args[t] = PassArgs{ &dst, &scratch, radius, W, H, ycur, ycur + take };
-        pthread_create(&tids[t], nullptr, &pass1_worker, &args[t]);
+        args[t] = PassArgs{ &m, &dst, &scratch, &plan, &kernels, opt.vertical_strips,
+                            acc.data() + (opt.vertical_strips ? size_t(t) * plan.strip : 0), W, H, ycur, ycur + take, band, &pool.barrier() };
         ycur += take;
     }
-    for (int t = 0; t < num_threads; ++t) pthread_join(tids[t], nullptr);
 
-    // ---- Pass 2 (vertical) ----
-    ycur = 0;
-    for (int t = 0; t < num_threads; ++t) {
-        const int take = rows_per + (t < extra ? 1 : 0);
-        args[t].y0 = ycur; args[t].y1 = ycur + take;
-        pthread_create(&tids[t], nullptr, &pass2_worker, &args[t]);
-        ycur += take;
-    }
-    for (int t = 0; t < num_threads; ++t) pthread_join(tids[t], nullptr);
+    // Fused bands and rings need their contiguous stripe (halo rows), so they stay static
+    using Schedule = ParallelOptions::Schedule;
+    const Schedule schedule = opt.fused || opt.low_memory ? Schedule::stripes : opt.schedule;
+    const int chunk = std::max(1, opt.chunk);
+    std::atomic<int> next[2] = { {0}, {0} };
+    // Band flags only when that schedule runs
+    std::optional<Wavefront> wf;
+    if (schedule == Schedule::wavefront) wf.emplace(H, chunk, radius);
 
-    return dst;
+    if (opt.busy) opt.busy->assign(num_threads, 0.0);
+    auto timed = [&](int t, auto&& work) {
+        const auto start = std::chrono::steady_clock::now();
+        work();
+        if (opt.busy)
+            (*opt.busy)[t] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    pool.run(num_threads, [&](int t) {
+        if (opt.low_memory) {
+            timed(t, [&] { ring_worker(&args[t]); });
+            return;
+        }
+        if (opt.fused) {
+            timed(t, [&] { fused_worker(&args[t]); });
+            return;
+        }
+        if (schedule == Schedule::wavefront) {
+            wavefront_worker(args[t], *wf, opt.busy ? &(*opt.busy)[t] : nullptr);
+            return;
+        }
+        // ---- Pass 1 (horizontal) ----
+        timed(t, [&] {
+            if (schedule == Schedule::dynamic) claim_rows(args[t], next[0], chunk, &pass1_worker);
+            else pass1_worker(&args[t]);
+        });
+        pool.barrier().wait();      // scratch complete, m fully consumed
+        // ---- Pass 2 (vertical) ----
+        timed(t, [&] {
+            if (schedule == Schedule::dynamic) claim_rows(args[t], next[1], chunk, &pass2_worker);
+            else pass2_worker(&args[t]);
+        });
+    });
+}
+
+/** Peak signal-to-noise ratio over all three planes (infinity if identical). */
+double psnr(const Matrix& a, const Matrix& b) {
+    const unsigned W = a.get_x_size(), H = a.get_y_size();
+    const size_t size = static_cast<size_t>(W) * H;
+
+    double se = 0.0;
+    for (int c = 0; c < 3; ++c)
+        for (unsigned y = 0; y < H; ++y) {
+            const unsigned char* pa = a.row(c, y);
+            const unsigned char* pb = b.row(c, y);
+            for (unsigned x = 0; x < W; ++x) {
+                const double d = double(pa[x]) - double(pb[x]);
+                se += d * d;
+            }
+        }
+    if (se == 0.0) return INFINITY;
+
+    const double mse = se / (3.0 * size);
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+unsigned max_abs_error(const Matrix& a, const Matrix& b) {
+    const unsigned W = a.get_x_size(), H = a.get_y_size();
+
+    unsigned worst = 0;
+    for (int c = 0; c < 3; ++c)
+        for (unsigned y = 0; y < H; ++y) {
+            const unsigned char* pa = a.row(c, y);
+            const unsigned char* pb = b.row(c, y);
+            for (unsigned x = 0; x < W; ++x)
+                worst = std::max<unsigned>(worst, std::abs(int(pa[x]) - int(pb[x])));
+        }
+    return worst;
 }
 
 } // namespace Filter
@@ -0,0 +1,46 @@
+/**
+* filters_scale.cpp - One image at several radii (Gaussian scale space)
+*   Gaussians compose: blurring with sigma_a and then sigma_b gives sigma
+*   sqrt(sigma_a^2 + sigma_b^2). sigma is proportional to the radius here,
+*   so radius r_k follows from r_{k-1} with a step of sqrt(r_k^2 - r_{k-1}^2),
+*   which is always smaller than r_k. The step radius is rounded to an
+*   integer and every stage is stored as u8, so cascaded outputs are close
+*   to, not identical with, direct blurs (see ScaleSpace::min_psnr).
+**/
+
+#include "filters.hpp"
+#include "matrix.hpp"
+
+#include <cmath>
+
+namespace Filter {
+
+    namespace ScaleSpace
+    {
+        int step_radius(int from, int to)
+        {
+            return static_cast<int>(std::lround(std::sqrt(double(to) * to - double(from) * from)));
+        }
+    }
+
+void blur_scale_space(const Matrix& m, const std::vector<int>& radii, std::vector<Matrix>& out,
+                      const BlurFn& blur, bool cascade, const std::function<void(size_t)>& on_ready)
+{
+    // Sized once up front: on_ready may hand out[i] to another thread
+    out.resize(radii.size());
+
+    for (size_t i = 0; i < radii.size(); ++i) {
+        if (!cascade || i == 0) {
+            blur(m, out[i], radii[i]);
+        } else {
+            const int step = ScaleSpace::step_radius(radii[i - 1], radii[i]);
+            if (step > 0)
+                blur(out[i - 1], out[i], step);
+            else
+                out[i] = out[i - 1];
+        }
+        if (on_ready) on_ready(i);
+    }
+}
+
+}
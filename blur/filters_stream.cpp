@@ -0,0 +1,101 @@
+/**
+* filters_stream.cpp - Out-of-core exact blur, one band of rows at a time
+*   The image never exists in memory as a whole: rows come from a
+*   PPM::StreamReader, are blurred horizontally on arrival into a window of
+*   band + 2R rows per plane, and an output band is blurred vertically as
+*   soon as the R rows below it are in. The last 2R horizontal rows are
+*   slid to the front of the window and carried into the next band.
+*   Peak memory is about W * (band + 2R) * 3 (window) + W * band * 3 * 3
+*   (input, output and the writer's interleave buffer) bytes, whatever H is.
+*   Same kernels, plan and rounding as blur_parallel, so the output is
+*   bit-identical to it.
+**/
+
+#include "filters.hpp"
+#include "parallel.hpp"
+#include "ppm.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace Filter {
+
+bool blur_stream(PPM::StreamReader& in, PPM::StreamWriter& out, const int radius, int num_threads, int band,
+                 const ParallelOptions& opt)
+{
+    const int W = static_cast<int>(in.get_x_size());
+    const int H = static_cast<int>(in.get_y_size());
+    const size_t row = static_cast<size_t>(W);
+    if (band < 1) band = 1;
+    if (band > H) band = H;
+
+    const Kernels::Plan plan { radius, W, H };
+    const Kernels::Dispatch& kernels = opt.specialize ? Kernels::select(opt.isa, radius) : Kernels::select(opt.isa);
+
+    // Halo rows that can matter: none past the image
+    const int R = std::min(radius, H - 1);
+    const int rows = band + 2 * R;
+    std::vector<unsigned char> window[3], input[3], output[3];
+    for (int c = 0; c < 3; ++c) {
+        window[c].resize(rows * row);
+        input[c].resize(band * row);
+        output[c].resize(band * row);
+    }
+
+    int base = 0; // image row held in window row 0
+    int have = 0; // horizontal rows [base, have) are in the window
+
+    for (int y0 = 0; y0 < H; y0 += band) {
+        const int y1 = std::min(H, y0 + band);
+        const int need = std::min(H, y1 + R);
+
+        // Carry the rows the next band's halo still reads, drop the rest
+        if (need - base > rows) {
+            const int keep = std::max(0, y0 - R);
+            for (int c = 0; c < 3; ++c)
+                std::memmove(window[c].data(), window[c].data() + (keep - base) * row, (have - keep) * row);
+            base = keep;
+        }
+
+        while (have < need) {
+            const int n = std::min(band, need - have);
+            if (!in.read_rows(n, input[0].data(), input[1].data(), input[2].data()))
+                return false;
+
+            Parallel::for_ranges(0, n, num_threads, [&](int lo, int hi) {
+                std::vector<double> tmp(W);
+                for (int r = lo; r < hi; ++r)
+                    for (int c = 0; c < 3; ++c)
+                        kernels.horizontal(input[c].data() + r * row, window[c].data() + (have + r - base) * row,
+                                           W, plan, tmp.data());
+            }, opt.pool);
+            have += n;
+        }
+
+        // Window rows are addressed by absolute image row, like fused_worker
+        Parallel::for_ranges(y0, y1, num_threads, [&](int lo, int hi) {
+            std::vector<double> acc(opt.vertical_strips ? plan.strip : 0);
+            for (int c = 0; c < 3; ++c) {
+                const unsigned char* src = window[c].data() - base * row;
+                unsigned char* dst = output[c].data() - y0 * row;
+                if (opt.vertical_strips) {
+                    for (int x0 = 0; x0 < W; x0 += plan.strip) {
+                        const int x1 = std::min(W, x0 + plan.strip);
+                        for (int y = lo; y < hi; ++y)
+                            kernels.vertical_strip(src, W, y, H, dst + y * row, x0, x1, plan, acc.data());
+                    }
+                    continue;
+                }
+                for (int y = lo; y < hi; ++y)
+                    kernels.vertical(src, W, y, H, dst + y * row, W, plan);
+            }
+        }, opt.pool);
+
+        if (!out.write_rows(y1 - y0, output[0].data(), output[1].data(), output[2].data()))
+            return false;
+    }
+    return out.close();
+}
+
+}
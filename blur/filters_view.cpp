@@ -0,0 +1,73 @@
+/**
+* filters_view.cpp - Exact blur between caller-owned buffers (ImageView)
+*   Same kernels, plan and two passes as blur_parallel, so the result is
+*   bit-identical to it. Planar views are read and written in place at
+*   their stride; interleaved rows are split into three row planes on the
+*   way in and merged again on the way out, one row per thread at a time.
+*   Only the horizontal intermediate is allocated (recycled via PlanePool).
+**/
+
+#include "filters.hpp"
+#include "image_view.hpp"
+#include "matrix.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace Filter {
+
+void blur_view(const ImageView& src, const ImageView& dst, const int radius, int num_threads, const ParallelOptions& opt) {
+    if (src.x_size != dst.x_size || src.y_size != dst.y_size)
+        throw std::runtime_error { "blur_view: source and destination sizes differ" };
+
+    const int W = static_cast<int>(src.x_size), H = static_cast<int>(src.y_size);
+    if (W == 0 || H == 0) return;
+
+    const Kernels::Plan plan { radius, W, H };
+    const Kernels::Dispatch& kernels = opt.specialize ? Kernels::select(opt.isa, radius) : Kernels::select(opt.isa);
+
+    Parallel::Pool& pool = opt.pool ? *opt.pool : Parallel::Pool::shared(num_threads);
+    num_threads = std::max(1, std::min({ num_threads, pool.size(), H }));
+
+    Matrix scratch { src.x_size, src.y_size, 0 };
+    const int mid_stride = static_cast<int>(scratch.stride());
+    const bool split_in = src.layout == ImageView::Layout::interleaved;
+    const bool split_out = dst.layout == ImageView::Layout::interleaved;
+
+    pool.run(num_threads, [&](int t) {
+        const int y0 = static_cast<int>(int64_t(H) * t / num_threads);
+        const int y1 = static_cast<int>(int64_t(H) * (t + 1) / num_threads);
+        std::vector<double> tmp(W);
+        std::vector<unsigned char> rows(split_in || split_out ? 3 * size_t(W) : 0);
+
+        // ---- Pass 1 (horizontal) ----
+        for (int y = y0; y < y1; ++y) {
+            const unsigned char* in = src.row(0, y);
+            if (split_in)
+                for (int x = 0; x < W; ++x)
+                    for (int c = 0; c < 3; ++c)
+                        rows[c * size_t(W) + x] = in[3 * x + c];
+            for (int c = 0; c < 3; ++c)
+                kernels.horizontal(split_in ? rows.data() + c * size_t(W) : src.row(c, y), scratch.row(c, y),
+                                   W, plan, tmp.data());
+        }
+        pool.barrier().wait();      // src fully consumed, dst may alias it
+
+        // ---- Pass 2 (vertical) ----
+        for (int y = y0; y < y1; ++y) {
+            for (int c = 0; c < 3; ++c)
+                kernels.vertical(scratch.plane(c), mid_stride, y, H, split_out ? rows.data() + c * size_t(W) : dst.row(c, y), W, plan);
+            if (split_out) {
+                unsigned char* out = dst.row(0, y);
+                for (int x = 0; x < W; ++x)
+                    for (int c = 0; c < 3; ++c)
+                        out[3 * x + c] = rows[c * size_t(W) + x];
+            }
+        }
+    });
+}
+
+}
@@ -0,0 +1,40 @@
+/**
+* image_view.hpp - Non-owning view of a caller's RGB image
+*   Either three planes (R, G, B) or one interleaved RGB buffer, with any
+*   row stride in bytes (>= x_size for planes, >= 3 * x_size interleaved).
+*   Nothing is copied or freed through a view; the caller keeps the memory
+*   alive while it is in use.
+**/
+
+#include <cstddef>
+
+#if !defined(IMAGE_VIEW_HPP)
+#define IMAGE_VIEW_HPP
+
+struct ImageView {
+    enum class Layout { planar, interleaved };
+
+    // planar: R, G, B planes; interleaved: plane[0] at the first R byte
+    unsigned char* plane[3] { nullptr, nullptr, nullptr };
+    unsigned x_size { 0 };
+    unsigned y_size { 0 };
+    size_t stride { 0 };                // bytes from one row to the next
+    Layout layout { Layout::planar };
+
+    static ImageView planar(unsigned char* R, unsigned char* G, unsigned char* B, unsigned x_size,
+                            unsigned y_size, size_t stride = 0)
+    {
+        return ImageView { { R, G, B }, x_size, y_size, stride ? stride : x_size, Layout::planar };
+    }
+
+    static ImageView interleaved(unsigned char* rgb, unsigned x_size, unsigned y_size, size_t stride = 0)
+    {
+        return ImageView { { rgb, nullptr, nullptr }, x_size, y_size, stride ? stride : size_t { 3 } * x_size,
+                           Layout::interleaved };
+    }
+
+    // Start of row y of plane c (planar) or of the RGB row (interleaved)
+    unsigned char* row(int c, unsigned y) const { return plane[layout == Layout::planar ? c : 0] + y * stride; }
+};
+
+#endif
@@ -0,0 +1,653 @@
+/**
+* kernels.cpp - Scalar and SSE4.1 / AVX2 / AVX-512 row kernels
+*   The vector kernels work on doubles (2/4/8 lanes) rather than float so the
+*   result stays identical to the sequential blur and verify.sh keeps passing.
+*   Each line is split into an interior, where every tap is in range and the
+*   normalizer is one constant, and borders that walk clamped tap ranges;
+*   no kernel tests bounds per tap.
+*   ISA-specific functions use GCC target attributes; select() picks them at
+*   runtime via cpuid, so the binary still runs on plain x86-64.
+*   The horizontal kernels and the scalar vertical one are also instantiated
+*   for the hot radii 1..max_hot_radius: full-span tap loops then have a
+*   compile-time trip count and are unrolled. (Unrolled SIMD vertical loops
+*   hoist 2R weight broadcasts and spill, so those stay generic.) Weights
+*   stay in the Plan (libm exp, once per call); a constexpr table would not
+*   match get_weights bit for bit.
+**/
+
+#include "kernels.hpp"
+#include "filters.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNELS_HAVE_X86 1
+#endif
+
+// Fully unroll fixed-radius tap loops (up to max_hot_radius taps per side)
+#define KERNELS_UNROLL _Pragma("GCC unroll 64")
+
+namespace Filter {
+
+namespace Kernels {
+
+Plan::Plan(int radius, int W, int H)
+    : radius(radius), w(radius + 1), norm_x(W), norm_y(H)
+{
+    strip = std::min(max_strip, std::max(64, strip_bytes / (2 * radius + 1))) & ~15;
+    Gauss::get_weights(radius, w.data());
+
+    // Accumulate exactly as the sequential filter does: w[0], then for each
+    // offset the left tap before the right one, skipping out-of-range taps.
+    auto fill = [&](std::vector<double>& norm, int size) {
+        for (int i = 0; i < size; ++i) {
+            double n = w[0];
+            for (int wi = 1; wi <= radius; ++wi) {
+                if (i - wi >= 0)   n += w[wi];
+                if (i + wi < size) n += w[wi];
+            }
+            norm[i] = n;
+        }
+    };
+    fill(norm_x, W);
+    fill(norm_y, H);
+}
+
+namespace {
+
+    /** Tap layout around position i of a line of n samples: offsets 1..both
+    * exist on both sides, offsets both+1..single only on side `dir`
+    * (-1 before i, +1 after). Interior positions have both == single == R.
+    **/
+    struct Span {
+        int both, single, dir;
+    };
+
+    inline Span span(int i, int n, int R)
+    {
+        const int before = i, after = n - 1 - i;
+        return { std::min({ R, before, after }), std::min(R, std::max(before, after)), before > after ? -1 : 1 };
+    }
+
+    /** Weighted sum around c (samples `step` apart) in the sequential
+    * filter's order: centre, then left/right per offset, then the single
+    * remaining side. Branch-free; out-of-range taps are simply not visited.
+    * B > 0: s is known to be the full span {B, B}, so the loop is fixed.
+    **/
+    template <int B = 0, typename T>
+    inline double taps(const T* c, long step, Span s, const double* w)
+    {
+        const int both = B ? B : s.both;
+        double r = w[0] * c[0];
+        KERNELS_UNROLL
+        for (int wi = 1; wi <= both; ++wi) {
+            r += w[wi] * c[-wi * step];
+            r += w[wi] * c[wi * step];
+        }
+        const long one = s.dir * step;
+        for (int wi = s.both + 1; wi <= s.single; ++wi)
+            r += w[wi] * c[wi * one];
+        return r;
+    }
+
+    /** Interior bounds [lo, hi) of a line: every tap of every position inside is in range. */
+    inline void interior(int n, int R, int& lo, int& hi)
+    {
+        lo = std::min(R, n);
+        hi = std::max(lo, n - R);
+    }
+
+    /** Border pixels [x0, x1) of a horizontal line, scalar. */
+    template <typename T>
+    inline void horizontal_border(const T* t, unsigned char* dst, int x0, int x1, int W, const Plan& p)
+    {
+        for (int x = x0; x < x1; ++x)
+            dst[x] = taps(t + x, 1, span(x, W, p.radius), p.w.data()) / p.norm_x[x];
+    }
+
+    /** Convert a row to doubles once, so vector taps are plain loads. */
+    const double* widen_row(const unsigned char* src, int W, double* tmp)
+    {
+        for (int x = 0; x < W; ++x) tmp[x] = src[x];
+        return tmp;
+    }
+
+    /** ---- Scalar: same arithmetic as the sequential filter, split into a
+    * branch-free interior (constant normalizer) and clamped border loops ---- */
+    template <int RC>
+    void horizontal_scalar(const unsigned char* src, unsigned char* dst, int W, const Plan& p, double*)
+    {
+        const int R = RC ? RC : p.radius;
+        int lo, hi;
+        interior(W, R, lo, hi);
+
+        horizontal_border(src, dst, 0, lo, W, p);
+        if (hi > lo) {
+            const double n = p.norm_x[lo];
+            const Span full { R, R, 1 };
+            for (int x = lo; x < hi; ++x)
+                dst[x] = taps<RC>(src + x, 1, full, p.w.data()) / n;
+        }
+        horizontal_border(src, dst, hi, W, W, p);
+    }
+
+    /** Scalar columns [x0, W) of output row y; the span is uniform over the row. */
+    template <int B = 0>
+    void vertical_from(const unsigned char* src, int stride, int y, int H, unsigned char* dst, int x0, int W, const Plan& p)
+    {
+        const Span s = span(y, H, p.radius);
+        const double n = p.norm_y[y];
+        const unsigned char* c = src + static_cast<long>(y) * stride;
+        for (int x = x0; x < W; ++x)
+            dst[x] = taps<B>(c + x, stride, s, p.w.data()) / n;
+    }
+
+    /** Rows whose taps all exist use the fixed-radius body when there is one. */
+    template <int RC>
+    inline bool full_row(int y, int H)
+    {
+        return RC && y >= RC && y + RC < H;
+    }
+
+    template <int RC>
+    void vertical_scalar(const unsigned char* src, int stride, int y, int H, unsigned char* dst, int W, const Plan& p)
+    {
+        if (full_row<RC>(y, H))
+            vertical_from<RC>(src, stride, y, H, dst, 0, W, p);
+        else
+            vertical_from(src, stride, y, H, dst, 0, W, p);
+    }
+
+    /** ---- Row-wise strip variant of the vertical pass ----
+    * Output row y over columns [x0, x1): acc[] starts as w0 * row y, then
+    * each tap row is added across the whole strip (AXPY) in the sequential
+    * tap order, so every element sees the same operations as in taps().
+    * Only 2R+1 row segments of the strip are live, instead of 2R+1 rows
+    * re-read per output pixel.
+    **/
+    void vertical_strip_scalar(const unsigned char* src, int stride, int y, int H, unsigned char* dst,
+                               int x0, int x1, const Plan& p, double* acc)
+    {
+        const double* w = p.w.data();
+        const Span s = span(y, H, p.radius);
+        const long one = s.dir * static_cast<long>(stride);
+        const unsigned char* c = src + static_cast<long>(y) * stride;
+        double* a = acc - x0;
+
+        for (int x = x0; x < x1; ++x) a[x] = w[0] * c[x];
+        for (int wi = 1; wi <= s.both; ++wi) {
+            const unsigned char* up = c - wi * stride;
+            const unsigned char* dn = c + wi * stride;
+            for (int x = x0; x < x1; ++x) {
+                a[x] += w[wi] * up[x];
+                a[x] += w[wi] * dn[x];
+            }
+        }
+        for (int wi = s.both + 1; wi <= s.single; ++wi) {
+            const unsigned char* o = c + wi * one;
+            for (int x = x0; x < x1; ++x) a[x] += w[wi] * o[x];
+        }
+        const double n = p.norm_y[y];
+        for (int x = x0; x < x1; ++x) dst[x] = a[x] / n;
+    }
+
+#if defined(KERNELS_HAVE_X86)
+
+    /** ---- SSE4.1: 2 doubles per vector ---- */
+    __attribute__((target("sse4.1"))) inline __m128d load2_u8(const unsigned char* p)
+    {
+        uint16_t v;
+        std::memcpy(&v, p, sizeof v);
+        return _mm_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(v)));
+    }
+
+    __attribute__((target("sse4.1"))) inline void store2_u8(unsigned char* p, __m128d v)
+    {
+        const __m128i i = _mm_cvttpd_epi32(v);
+        const uint16_t b = static_cast<uint16_t>(_mm_cvtsi128_si32(_mm_packus_epi16(_mm_packus_epi32(i, i), i)));
+        std::memcpy(p, &b, sizeof b);
+    }
+
+    template <int RC>
+    __attribute__((target("sse4.1"))) void horizontal_sse41(const unsigned char* src, unsigned char* dst, int W, const Plan& p, double* tmp)
+    {
+        const int R = RC ? RC : p.radius;
+        const double* w = p.w.data();
+        const double* t = widen_row(src, W, tmp);
+        int lo, hi;
+        interior(W, R, lo, hi);
+
+        horizontal_border(t, dst, 0, lo, W, p);
+        int x = lo;
+        if (hi > lo) {
+            const __m128d n = _mm_set1_pd(p.norm_x[lo]);
+            for (; x + 2 <= hi; x += 2) {
+                __m128d acc = _mm_mul_pd(_mm_set1_pd(w[0]), _mm_loadu_pd(t + x));
+                KERNELS_UNROLL
+                for (int wi = 1; wi <= R; ++wi) {
+                    const __m128d wc = _mm_set1_pd(w[wi]);
+                    acc = _mm_add_pd(acc, _mm_mul_pd(wc, _mm_loadu_pd(t + x - wi)));
+                    acc = _mm_add_pd(acc, _mm_mul_pd(wc, _mm_loadu_pd(t + x + wi)));
+                }
+                store2_u8(dst + x, _mm_div_pd(acc, n));
+            }
+        }
+        horizontal_border(t, dst, x, W, W, p);
+    }
+
+    __attribute__((target("sse4.1"))) void vertical_sse41(const unsigned char* src, int stride, int y, int H, unsigned char* dst, int W, const Plan& p)
+    {
+        const double* w = p.w.data();
+        const Span s = span(y, H, p.radius);
+        const long one = s.dir * static_cast<long>(stride);
+        const __m128d n = _mm_set1_pd(p.norm_y[y]);
+
+        int x = 0;
+        for (; x + 2 <= W; x += 2) {
+            const unsigned char* c = src + static_cast<long>(y) * stride + x;
+            __m128d acc = _mm_mul_pd(_mm_set1_pd(w[0]), load2_u8(c));
+            for (int wi = 1; wi <= s.both; ++wi) {
+                const __m128d wc = _mm_set1_pd(w[wi]);
+                acc = _mm_add_pd(acc, _mm_mul_pd(wc, load2_u8(c - wi * stride)));
+                acc = _mm_add_pd(acc, _mm_mul_pd(wc, load2_u8(c + wi * stride)));
+            }
+            for (int wi = s.both + 1; wi <= s.single; ++wi)
+                acc = _mm_add_pd(acc, _mm_mul_pd(_mm_set1_pd(w[wi]), load2_u8(c + wi * one)));
+            store2_u8(dst + x, _mm_div_pd(acc, n));
+        }
+        vertical_from(src, stride, y, H, dst, x, W, p);
+    }
+
+    __attribute__((target("sse4.1"))) void vertical_strip_sse41(const unsigned char* src, int stride, int y, int H, unsigned char* dst,
+                               int x0, int x1, const Plan& p, double* acc)
+    {
+        const double* w = p.w.data();
+        const Span s = span(y, H, p.radius);
+        const long one = s.dir * static_cast<long>(stride);
+        const unsigned char* c = src + static_cast<long>(y) * stride;
+        const int xv = x0 + ((x1 - x0) / 2) * 2;   // vector part [x0, xv)
+        double* a = acc - x0;
+
+        const __m128d w0 = _mm_set1_pd(w[0]);
+        for (int x = x0; x < xv; x += 2) _mm_storeu_pd(a + x, _mm_mul_pd(w0, load2_u8(c + x)));
+        for (int x = xv; x < x1; ++x) a[x] = w[0] * c[x];
+
+        for (int wi = 1; wi <= s.both; ++wi) {
+            const __m128d wc = _mm_set1_pd(w[wi]);
+            const unsigned char* up = c - wi * stride;
+            const unsigned char* dn = c + wi * stride;
+            for (int x = x0; x < xv; x += 2) {
+                __m128d v = _mm_add_pd(_mm_loadu_pd(a + x), _mm_mul_pd(wc, load2_u8(up + x)));
+                _mm_storeu_pd(a + x, _mm_add_pd(v, _mm_mul_pd(wc, load2_u8(dn + x))));
+            }
+            for (int x = xv; x < x1; ++x) {
+                a[x] += w[wi] * up[x];
+                a[x] += w[wi] * dn[x];
+            }
+        }
+        for (int wi = s.both + 1; wi <= s.single; ++wi) {
+            const __m128d wc = _mm_set1_pd(w[wi]);
+            const unsigned char* o = c + wi * one;
+            for (int x = x0; x < xv; x += 2) _mm_storeu_pd(a + x, _mm_add_pd(_mm_loadu_pd(a + x), _mm_mul_pd(wc, load2_u8(o + x))));
+            for (int x = xv; x < x1; ++x) a[x] += w[wi] * o[x];
+        }
+
+        const double n = p.norm_y[y];
+        const __m128d nv = _mm_set1_pd(n);
+        for (int x = x0; x < xv; x += 2) store2_u8(dst + x, _mm_div_pd(_mm_loadu_pd(a + x), nv));
+        for (int x = xv; x < x1; ++x) dst[x] = a[x] / n;
+    }
+
+    /** ---- AVX2: 4 doubles per vector, two vectors per iteration ---- */
+    __attribute__((target("avx2"))) inline __m256d load4_u8(const unsigned char* p)
+    {
+        int v;
+        std::memcpy(&v, p, sizeof v);
+        return _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(v)));
+    }
+
+    __attribute__((target("avx2"))) inline void store4_u8(unsigned char* p, __m256d v)
+    {
+        const __m128i i = _mm256_cvttpd_epi32(v);
+        const int b = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packus_epi32(i, i), i));
+        std::memcpy(p, &b, sizeof b);
+    }
+
+    template <int RC>
+    __attribute__((target("avx2"))) void horizontal_avx2(const unsigned char* src, unsigned char* dst, int W, const Plan& p, double* tmp)
+    {
+        const int R = RC ? RC : p.radius;
+        const double* w = p.w.data();
+        const double* t = widen_row(src, W, tmp);
+        int lo, hi;
+        interior(W, R, lo, hi);
+
+        horizontal_border(t, dst, 0, lo, W, p);
+        int x = lo;
+        if (hi > lo) {
+            const __m256d n = _mm256_set1_pd(p.norm_x[lo]);
+            for (; x + 8 <= hi; x += 8) {
+                const __m256d w0 = _mm256_set1_pd(w[0]);
+                __m256d a0 = _mm256_mul_pd(w0, _mm256_loadu_pd(t + x));
+                __m256d a1 = _mm256_mul_pd(w0, _mm256_loadu_pd(t + x + 4));
+                KERNELS_UNROLL
+                for (int wi = 1; wi <= R; ++wi) {
+                    const __m256d wc = _mm256_set1_pd(w[wi]);
+                    a0 = _mm256_add_pd(a0, _mm256_mul_pd(wc, _mm256_loadu_pd(t + x - wi)));
+                    a1 = _mm256_add_pd(a1, _mm256_mul_pd(wc, _mm256_loadu_pd(t + x + 4 - wi)));
+                    a0 = _mm256_add_pd(a0, _mm256_mul_pd(wc, _mm256_loadu_pd(t + x + wi)));
+                    a1 = _mm256_add_pd(a1, _mm256_mul_pd(wc, _mm256_loadu_pd(t + x + 4 + wi)));
+                }
+                store4_u8(dst + x,     _mm256_div_pd(a0, n));
+                store4_u8(dst + x + 4, _mm256_div_pd(a1, n));
+            }
+        }
+        horizontal_border(t, dst, x, W, W, p);
+    }
+
+    __attribute__((target("avx2"))) void vertical_avx2(const unsigned char* src, int stride, int y, int H, unsigned char* dst, int W, const Plan& p)
+    {
+        const double* w = p.w.data();
+        const Span s = span(y, H, p.radius);
+        const long one = s.dir * static_cast<long>(stride);
+        const __m256d n = _mm256_set1_pd(p.norm_y[y]);
+
+        int x = 0;
+        for (; x + 8 <= W; x += 8) {
+            const unsigned char* c = src + static_cast<long>(y) * stride + x;
+            const __m256d w0 = _mm256_set1_pd(w[0]);
+            __m256d a0 = _mm256_mul_pd(w0, load4_u8(c));
+            __m256d a1 = _mm256_mul_pd(w0, load4_u8(c + 4));
+            for (int wi = 1; wi <= s.both; ++wi) {
+                const __m256d wc = _mm256_set1_pd(w[wi]);
+                const unsigned char* up = c - wi * stride;
+                const unsigned char* dn = c + wi * stride;
+                a0 = _mm256_add_pd(a0, _mm256_mul_pd(wc, load4_u8(up)));
+                a1 = _mm256_add_pd(a1, _mm256_mul_pd(wc, load4_u8(up + 4)));
+                a0 = _mm256_add_pd(a0, _mm256_mul_pd(wc, load4_u8(dn)));
+                a1 = _mm256_add_pd(a1, _mm256_mul_pd(wc, load4_u8(dn + 4)));
+            }
+            for (int wi = s.both + 1; wi <= s.single; ++wi) {
+                const __m256d wc = _mm256_set1_pd(w[wi]);
+                const unsigned char* o = c + wi * one;
+                a0 = _mm256_add_pd(a0, _mm256_mul_pd(wc, load4_u8(o)));
+                a1 = _mm256_add_pd(a1, _mm256_mul_pd(wc, load4_u8(o + 4)));
+            }
+            store4_u8(dst + x,     _mm256_div_pd(a0, n));
+            store4_u8(dst + x + 4, _mm256_div_pd(a1, n));
+        }
+        vertical_from(src, stride, y, H, dst, x, W, p);
+    }
+
+    __attribute__((target("avx2"))) void vertical_strip_avx2(const unsigned char* src, int stride, int y, int H, unsigned char* dst,
+                               int x0, int x1, const Plan& p, double* acc)
+    {
+        const double* w = p.w.data();
+        const Span s = span(y, H, p.radius);
+        const long one = s.dir * static_cast<long>(stride);
+        const unsigned char* c = src + static_cast<long>(y) * stride;
+        const int xv = x0 + ((x1 - x0) / 4) * 4;   // vector part [x0, xv)
+        double* a = acc - x0;
+
+        const __m256d w0 = _mm256_set1_pd(w[0]);
+        for (int x = x0; x < xv; x += 4) _mm256_storeu_pd(a + x, _mm256_mul_pd(w0, load4_u8(c + x)));
+        for (int x = xv; x < x1; ++x) a[x] = w[0] * c[x];
+
+        for (int wi = 1; wi <= s.both; ++wi) {
+            const __m256d wc = _mm256_set1_pd(w[wi]);
+            const unsigned char* up = c - wi * stride;
+            const unsigned char* dn = c + wi * stride;
+            for (int x = x0; x < xv; x += 4) {
+                __m256d v = _mm256_add_pd(_mm256_loadu_pd(a + x), _mm256_mul_pd(wc, load4_u8(up + x)));
+                _mm256_storeu_pd(a + x, _mm256_add_pd(v, _mm256_mul_pd(wc, load4_u8(dn + x))));
+            }
+            for (int x = xv; x < x1; ++x) {
+                a[x] += w[wi] * up[x];
+                a[x] += w[wi] * dn[x];
+            }
+        }
+        for (int wi = s.both + 1; wi <= s.single; ++wi) {
+            const __m256d wc = _mm256_set1_pd(w[wi]);
+            const unsigned char* o = c + wi * one;
+            for (int x = x0; x < xv; x += 4) _mm256_storeu_pd(a + x, _mm256_add_pd(_mm256_loadu_pd(a + x), _mm256_mul_pd(wc, load4_u8(o + x))));
+            for (int x = xv; x < x1; ++x) a[x] += w[wi] * o[x];
+        }
+
+        const double n = p.norm_y[y];
+        const __m256d nv = _mm256_set1_pd(n);
+        for (int x = x0; x < xv; x += 4) store4_u8(dst + x, _mm256_div_pd(_mm256_loadu_pd(a + x), nv));
+        for (int x = xv; x < x1; ++x) dst[x] = a[x] / n;
+    }
+
+    /** ---- AVX-512F: 8 doubles per vector, two vectors per iteration ----
+    * The maskz conversions avoid GCC 12's -Wmaybe-uninitialized noise from
+    * the _mm*_undefined passthrough operands of the unmasked forms.
+    **/
+    __attribute__((target("avx512f"))) inline __m512d load8_u8(const unsigned char* p)
+    {
+        const __m256i i = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+        return _mm512_maskz_cvtepi32_pd(0xFF, i);
+    }
+
+    // Truncate 2 x 8 doubles and pack them into 16 bytes
+    __attribute__((target("avx512f"))) inline void store16_u8(unsigned char* p, __m512d lo, __m512d hi)
+    {
+        const __m256i w = _mm256_packus_epi32(_mm512_maskz_cvttpd_epi32(0xFF, lo), _mm512_maskz_cvttpd_epi32(0xFF, hi));
+        const __m256i o = _mm256_permute4x64_epi64(w, 0xD8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p),
+                         _mm_packus_epi16(_mm256_castsi256_si128(o), _mm256_extracti128_si256(o, 1)));
+    }
+
+    template <int RC>
+    __attribute__((target("avx512f"))) void horizontal_avx512(const unsigned char* src, unsigned char* dst, int W, const Plan& p, double* tmp)
+    {
+        const int R = RC ? RC : p.radius;
+        const double* w = p.w.data();
+        const double* t = widen_row(src, W, tmp);
+        int lo, hi;
+        interior(W, R, lo, hi);
+
+        horizontal_border(t, dst, 0, lo, W, p);
+        int x = lo;
+        if (hi > lo) {
+            const __m512d n = _mm512_set1_pd(p.norm_x[lo]);
+            for (; x + 16 <= hi; x += 16) {
+                const __m512d w0 = _mm512_set1_pd(w[0]);
+                __m512d a0 = _mm512_mul_pd(w0, _mm512_loadu_pd(t + x));
+                __m512d a1 = _mm512_mul_pd(w0, _mm512_loadu_pd(t + x + 8));
+                KERNELS_UNROLL
+                for (int wi = 1; wi <= R; ++wi) {
+                    const __m512d wc = _mm512_set1_pd(w[wi]);
+                    a0 = _mm512_add_pd(a0, _mm512_mul_pd(wc, _mm512_loadu_pd(t + x - wi)));
+                    a1 = _mm512_add_pd(a1, _mm512_mul_pd(wc, _mm512_loadu_pd(t + x + 8 - wi)));
+                    a0 = _mm512_add_pd(a0, _mm512_mul_pd(wc, _mm512_loadu_pd(t + x + wi)));
+                    a1 = _mm512_add_pd(a1, _mm512_mul_pd(wc, _mm512_loadu_pd(t + x + 8 + wi)));
+                }
+                store16_u8(dst + x, _mm512_div_pd(a0, n), _mm512_div_pd(a1, n));
+            }
+        }
+        horizontal_border(t, dst, x, W, W, p);
+    }
+
+    __attribute__((target("avx512f"))) void vertical_avx512(const unsigned char* src, int stride, int y, int H, unsigned char* dst, int W, const Plan& p)
+    {
+        const double* w = p.w.data();
+        const Span s = span(y, H, p.radius);
+        const long one = s.dir * static_cast<long>(stride);
+        const __m512d n = _mm512_set1_pd(p.norm_y[y]);
+
+        int x = 0;
+        for (; x + 16 <= W; x += 16) {
+            const unsigned char* c = src + static_cast<long>(y) * stride + x;
+            const __m512d w0 = _mm512_set1_pd(w[0]);
+            __m512d a0 = _mm512_mul_pd(w0, load8_u8(c));
+            __m512d a1 = _mm512_mul_pd(w0, load8_u8(c + 8));
+            for (int wi = 1; wi <= s.both; ++wi) {
+                const __m512d wc = _mm512_set1_pd(w[wi]);
+                const unsigned char* up = c - wi * stride;
+                const unsigned char* dn = c + wi * stride;
+                a0 = _mm512_add_pd(a0, _mm512_mul_pd(wc, load8_u8(up)));
+                a1 = _mm512_add_pd(a1, _mm512_mul_pd(wc, load8_u8(up + 8)));
+                a0 = _mm512_add_pd(a0, _mm512_mul_pd(wc, load8_u8(dn)));
+                a1 = _mm512_add_pd(a1, _mm512_mul_pd(wc, load8_u8(dn + 8)));
+            }
+            for (int wi = s.both + 1; wi <= s.single; ++wi) {
+                const __m512d wc = _mm512_set1_pd(w[wi]);
+                const unsigned char* o = c + wi * one;
+                a0 = _mm512_add_pd(a0, _mm512_mul_pd(wc, load8_u8(o)));
+                a1 = _mm512_add_pd(a1, _mm512_mul_pd(wc, load8_u8(o + 8)));
+            }
+            store16_u8(dst + x, _mm512_div_pd(a0, n), _mm512_div_pd(a1, n));
+        }
+        vertical_from(src, stride, y, H, dst, x, W, p);
+    }
+
+    __attribute__((target("avx512f"))) void vertical_strip_avx512(const unsigned char* src, int stride, int y, int H, unsigned char* dst,
+                               int x0, int x1, const Plan& p, double* acc)
+    {
+        const double* w = p.w.data();
+        const Span s = span(y, H, p.radius);
+        const long one = s.dir * static_cast<long>(stride);
+        const unsigned char* c = src + static_cast<long>(y) * stride;
+        const int xv = x0 + ((x1 - x0) / 16) * 16;   // vector part [x0, xv)
+        double* a = acc - x0;
+
+        const __m512d w0 = _mm512_set1_pd(w[0]);
+        for (int x = x0; x < xv; x += 8) _mm512_storeu_pd(a + x, _mm512_mul_pd(w0, load8_u8(c + x)));
+        for (int x = xv; x < x1; ++x) a[x] = w[0] * c[x];
+
+        for (int wi = 1; wi <= s.both; ++wi) {
+            const __m512d wc = _mm512_set1_pd(w[wi]);
+            const unsigned char* up = c - wi * stride;
+            const unsigned char* dn = c + wi * stride;
+            for (int x = x0; x < xv; x += 8) {
+                __m512d v = _mm512_add_pd(_mm512_loadu_pd(a + x), _mm512_mul_pd(wc, load8_u8(up + x)));
+                _mm512_storeu_pd(a + x, _mm512_add_pd(v, _mm512_mul_pd(wc, load8_u8(dn + x))));
+            }
+            for (int x = xv; x < x1; ++x) {
+                a[x] += w[wi] * up[x];
+                a[x] += w[wi] * dn[x];
+            }
+        }
+        for (int wi = s.both + 1; wi <= s.single; ++wi) {
+            const __m512d wc = _mm512_set1_pd(w[wi]);
+            const unsigned char* o = c + wi * one;
+            for (int x = x0; x < xv; x += 8) _mm512_storeu_pd(a + x, _mm512_add_pd(_mm512_loadu_pd(a + x), _mm512_mul_pd(wc, load8_u8(o + x))));
+            for (int x = xv; x < x1; ++x) a[x] += w[wi] * o[x];
+        }
+
+        const double n = p.norm_y[y];
+        const __m512d nv = _mm512_set1_pd(n);
+        for (int x = x0; x < xv; x += 16)
+            store16_u8(dst + x, _mm512_div_pd(_mm512_loadu_pd(a + x), nv), _mm512_div_pd(_mm512_loadu_pd(a + x + 8), nv));
+        for (int x = xv; x < x1; ++x) dst[x] = a[x] / n;
+    }
+
+#endif
+
+    /** Kernels for one ISA; RC > 0 fixes the radius where that pays off. */
+    template <int RC>
+    constexpr Dispatch entry(Isa isa)
+    {
+        switch (isa) {
+#if defined(KERNELS_HAVE_X86)
+        case Isa::sse41:  return { isa, &horizontal_sse41<RC>,  &vertical_sse41,   &vertical_strip_sse41,  RC };
+        case Isa::avx2:   return { isa, &horizontal_avx2<RC>,   &vertical_avx2,    &vertical_strip_avx2,   RC };
+        case Isa::avx512: return { isa, &horizontal_avx512<RC>, &vertical_avx512,  &vertical_strip_avx512, RC };
+#endif
+        default:          return { Isa::scalar, &horizontal_scalar<RC>, &vertical_scalar<RC>, &vertical_strip_scalar, RC };
+        }
+    }
+
+    const Dispatch table[] = {
+        entry<0>(Isa::scalar),
+#if defined(KERNELS_HAVE_X86)
+        entry<0>(Isa::sse41),
+        entry<0>(Isa::avx2),
+        entry<0>(Isa::avx512),
+#endif
+    };
+
+    template <size_t... I>
+    constexpr std::array<Dispatch, sizeof...(I)> hot_entries(Isa isa, std::index_sequence<I...>)
+    {
+        return { { entry<static_cast<int>(I) + 1>(isa)... } };
+    }
+
+    // hot[isa][radius - 1]
+    using HotRow = std::array<Dispatch, max_hot_radius>;
+    const HotRow hot[] = {
+        hot_entries(Isa::scalar, std::make_index_sequence<max_hot_radius>{}),
+#if defined(KERNELS_HAVE_X86)
+        hot_entries(Isa::sse41,  std::make_index_sequence<max_hot_radius>{}),
+        hot_entries(Isa::avx2,   std::make_index_sequence<max_hot_radius>{}),
+        hot_entries(Isa::avx512, std::make_index_sequence<max_hot_radius>{}),
+#endif
+    };
+
+}
+
+Isa detect()
+{
+#if defined(KERNELS_HAVE_X86)
+    static const Isa best = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) return Isa::avx512;
+        if (__builtin_cpu_supports("avx2"))    return Isa::avx2;
+        if (__builtin_cpu_supports("sse4.1"))  return Isa::sse41;
+        return Isa::scalar;
+    }();
+    return best;
+#else
+    return Isa::scalar;
+#endif
+}
+
+const Dispatch& select(Isa isa)
+{
+    const Isa best = detect();
+    if (static_cast<int>(isa) > static_cast<int>(best)) isa = best;
+    return table[static_cast<int>(isa)];
+}
+
+const Dispatch& select()
+{
+    return select(detect());
+}
+
+const Dispatch& select(Isa isa, int radius)
+{
+    const Dispatch& generic = select(isa);
+    if (radius < 1 || radius > max_hot_radius) return generic;
+    return hot[static_cast<int>(generic.isa)][radius - 1];
+}
+
+const char* name(Isa isa)
+{
+    switch (isa) {
+    case Isa::sse41:  return "sse4.1";
+    case Isa::avx2:   return "avx2";
+    case Isa::avx512: return "avx512";
+    default:          return "scalar";
+    }
+}
+
+bool parse(const char* s, Isa& out)
+{
+    for (Isa isa : { Isa::scalar, Isa::sse41, Isa::avx2, Isa::avx512 }) {
+        if (std::strcmp(s, name(isa)) == 0) {
+            out = isa;
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+}
@@ -0,0 +1,84 @@
+/**
+* kernels.hpp - Per-row Gaussian kernels behind blur_parallel
+*   Every kernel reproduces the sequential filter bit for bit: same double
+*   arithmetic, same tap order (centre, then left/right per offset), same
+*   normalizer accumulation and the same truncating store. Normalizers are
+*   precomputed per position; out-of-range taps are never visited.
+*   (Pre-normalized weights or reciprocals would save the one division per
+*   output pixel, but change the rounding, so they are not used.)
+**/
+
+#include <vector>
+
+#if !defined(KERNELS_HPP)
+#define KERNELS_HPP
+
+namespace Filter {
+
+namespace Kernels {
+
+    // Weights and normalizers for one image shape, built once per blur call
+    // and shared read-only by all workers.
+    struct Plan {
+        int radius;
+        std::vector<double> w;       // w[0..radius]
+        std::vector<double> norm_x;  // sum of in-range weights around each x
+        std::vector<double> norm_y;  // same for each y
+        int strip;                   // column tile width for vertical_strip
+
+        Plan(int radius, int W, int H);
+    };
+
+    // Budget for the 2R+1 live row segments of one vertical strip (fits L2)
+    constexpr int strip_bytes = 192 * 1024;
+    // Accumulator strip cap: 1024 doubles = 8 KiB, stays in L1
+    constexpr int max_strip = 1024;
+
+    // Horizontal: blur one plane row src[0..W) into dst[0..W).
+    // tmp must hold W doubles (row widened once for the vector kernels).
+    using HorizontalFn = void (*)(const unsigned char* src, unsigned char* dst, int W,
+                                  const Plan& p, double* tmp);
+    // Vertical: output row y of a plane with row stride `stride` and H rows.
+    using VerticalFn = void (*)(const unsigned char* src, int stride, int y, int H,
+                                unsigned char* dst, int W, const Plan& p);
+
+    // Vertical, row-wise: output row y over columns [x0, x1) by accumulating
+    // whole tap rows into acc (x1 - x0 doubles); dst points at row y.
+    using VerticalStripFn = void (*)(const unsigned char* src, int stride, int y, int H,
+                                     unsigned char* dst, int x0, int x1, const Plan& p, double* acc);
+
+    enum class Isa { scalar, sse41, avx2, avx512 };
+
+    struct Dispatch {
+        Isa isa;
+        HorizontalFn horizontal;
+        VerticalFn vertical;
+        VerticalStripFn vertical_strip;
+        int radius;     // > 0: kernels only valid for this radius
+    };
+
+    // Radii 1..max_hot_radius get kernels with the radius as a compile-time
+    // constant (unrolled taps); set with -DKERNELS_MAX_HOT_RADIUS=N in
+    // CXXFLAGS, 0 keeps only the generic kernels.
+#if defined(KERNELS_MAX_HOT_RADIUS)
+    constexpr int max_hot_radius = KERNELS_MAX_HOT_RADIUS;
+#else
+    constexpr int max_hot_radius = 32;
+#endif
+
+    // Best instruction set the CPU supports (cpuid, resolved once)
+    Isa detect();
+    // Kernels for `isa`, downgraded to what the CPU supports
+    const Dispatch& select(Isa isa);
+    const Dispatch& select();
+    // Fixed-radius kernels for `radius` if it is a hot one, else select(isa)
+    const Dispatch& select(Isa isa, int radius);
+
+    const char* name(Isa isa);
+    bool parse(const char* s, Isa& out);
+
+}
+
+}
+
+#endif
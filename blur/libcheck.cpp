@@ -0,0 +1,159 @@
+/**
+* libcheck.cpp - Bit-identity checks for the libblur.a entry points that
+*   blur_par does not reach, against blur_parallel on the same input:
+*     IncrementalBlur   random dirty rectangles, some crossing the edges
+*     blur_view         interleaved in place and planar -> interleaved, both
+*                       with padded strides whose padding must survive
+*   Runs on the given PPM (default data/im1.ppm) and on seeded noise images
+*   of awkward shapes. Prints each mismatch; exit status 1 if there was any.
+**/
+
+#include "filters.hpp"
+#include "image_view.hpp"
+#include "matrix.hpp"
+#include "ppm.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::mt19937 rng { 1674 };
+
+Matrix noise(unsigned x_size, unsigned y_size)
+{
+    Matrix m { x_size, y_size, 255 };
+    for (int c = 0; c < 3; ++c)
+        for (unsigned y = 0; y < y_size; ++y)
+            for (unsigned x = 0; x < x_size; ++x)
+                m.row(c, y)[x] = static_cast<unsigned char>(rng());
+    return m;
+}
+
+bool same(const Matrix& a, const Matrix& b)
+{
+    if (a.get_x_size() != b.get_x_size() || a.get_y_size() != b.get_y_size()) return false;
+    for (int c = 0; c < 3; ++c)
+        for (unsigned y = 0; y < a.get_y_size(); ++y)
+            if (std::memcmp(a.row(c, y), b.row(c, y), a.get_x_size()) != 0) return false;
+    return true;
+}
+
+// A rectangle anywhere from a little above/left of the image to a little
+// past it, so some are clipped by the edges
+Filter::Rect random_rect(int W, int H)
+{
+    const int x = static_cast<int>(rng() % (W + 8)) - 4;
+    const int y = static_cast<int>(rng() % (H + 8)) - 4;
+    const int w = 1 + static_cast<int>(rng() % std::max(1, W / 3));
+    const int h = 1 + static_cast<int>(rng() % std::max(1, H / 3));
+    return Filter::Rect { x, y, x + w, y + h };
+}
+
+int check_incremental(const std::string& name, const Matrix& image, int radius)
+{
+    Matrix m { image }, expected {};
+    const int W = static_cast<int>(m.get_x_size()), H = static_cast<int>(m.get_y_size());
+    int bad = 0;
+
+    Filter::IncrementalBlur inc { radius, 3 };
+    inc.reset(m);
+    for (int round = 0; round < 4; ++round) {
+        std::vector<Filter::Rect> dirty {};
+        for (int k = 0; k < 3; ++k) {
+            const Filter::Rect r { random_rect(W, H) };
+            dirty.push_back(r);
+            for (int y = std::max(0, r.y0); y < std::min(H, r.y1); ++y)
+                for (int x = std::max(0, r.x0); x < std::min(W, r.x1); ++x)
+                    m.row(k, y)[x] = static_cast<unsigned char>(rng());
+        }
+        inc.update(m, dirty);
+        Filter::blur_parallel(m, expected, radius, 2);
+        if (!same(inc.get_output(), expected)) {
+            std::cout << "incremental: " << name << " r" << radius << " round " << round << " differs\n";
+            ++bad;
+        }
+    }
+    return bad;
+}
+
+int check_view(const std::string& name, const Matrix& m, int radius)
+{
+    const unsigned W { m.get_x_size() }, H { m.get_y_size() };
+    Matrix expected {};
+    Filter::blur_parallel(m, expected, radius, 2);
+
+    // Padded strides, filled with a marker the blur must not overwrite
+    const size_t planar_stride { W + 13 }, rgb_stride { 3 * size_t { W } + 7 };
+    std::vector<unsigned char> planes(3 * planar_stride * H, 0xAB), rgb(rgb_stride * H, 0xCD),
+        out(rgb_stride * H, 0xEE);
+    for (unsigned y = 0; y < H; ++y)
+        for (unsigned x = 0; x < W; ++x)
+            for (int c = 0; c < 3; ++c) {
+                planes[(c * H + y) * planar_stride + x] = m.row(c, y)[x];
+                rgb[y * rgb_stride + 3 * x + c] = m.row(c, y)[x];
+            }
+
+    const auto planar { ImageView::planar(planes.data(), planes.data() + planar_stride * H,
+                                          planes.data() + 2 * planar_stride * H, W, H, planar_stride) };
+    const auto in_place { ImageView::interleaved(rgb.data(), W, H, rgb_stride) };
+    const auto other { ImageView::interleaved(out.data(), W, H, rgb_stride) };
+    Filter::blur_view(in_place, in_place, radius, 3);
+    Filter::blur_view(planar, other, radius, 2);
+
+    int bad = 0;
+    for (unsigned y = 0; y < H; ++y) {
+        for (unsigned x = 0; x < W; ++x)
+            for (int c = 0; c < 3; ++c) {
+                const unsigned char want { expected.row(c, y)[x] };
+                if (rgb[y * rgb_stride + 3 * x + c] != want || out[y * rgb_stride + 3 * x + c] != want) ++bad;
+            }
+        for (size_t x = 3 * size_t { W }; x < rgb_stride; ++x)
+            if (rgb[y * rgb_stride + x] != 0xCD || out[y * rgb_stride + x] != 0xEE) ++bad;
+    }
+    if (bad)
+        std::cout << "view: " << name << " r" << radius << " " << bad << " bytes differ\n";
+    return bad ? 1 : 0;
+}
+
+}
+
+int main(int argc, char const* argv[])
+{
+    const std::string path { argc > 1 ? argv[1] : "data/im1.ppm" };
+    std::vector<std::pair<std::string, Matrix>> images {};
+    images.emplace_back(path, PPM::MappedReader {}(path));
+    if (images.back().second.get_x_size() == 0) return 1;
+    for (auto [w, h] : { std::pair<unsigned, unsigned> { 65, 33 }, { 1, 37 }, { 37, 1 }, { 300, 7 } })
+        images.emplace_back("noise " + std::to_string(w) + "x" + std::to_string(h), noise(w, h));
+
+    int cases = 0, bad = 0;
+    for (const auto& [name, image] : images)
+        for (int radius : { 1, 5, 40 }) {
+            bad += check_incremental(name, image, radius);
+            bad += check_view(name, image, radius);
+            cases += 2;
+        }
+
+    // update() before any reset(), then with an image of another size
+    {
+        Filter::IncrementalBlur inc { 5, 2 };
+        Matrix expected {};
+        for (const auto& [name, image] : images) {
+            inc.update(image, { Filter::Rect { 0, 0, 1, 1 } });
+            Filter::blur_parallel(image, expected, 5, 2);
+            if (!same(inc.get_output(), expected)) {
+                std::cout << "incremental: " << name << " without a matching reset() differs\n";
+                ++bad;
+            }
+            ++cases;
+        }
+    }
+
+    std::cout << "libcheck: " << cases << " cases, " << bad << " mismatches\n";
+    return bad == 0 ? 0 : 1;
+}
@@ -4,165 +4,219 @@ Author: David Holmqvist <daae19@student.bth.se>
 
 #include "matrix.hpp"
 #include "ppm.hpp"
+#include <algorithm>
 #include <fstream>
+#include <new>
 #include <stdexcept>
+#include <utility>
 
-Matrix::Matrix(unsigned char* R, unsigned char* G, unsigned char* B, unsigned x_size, unsigned y_size, unsigned color_max)
-    : R { R }
-    , G { G }
-    , B { B }
-    , x_size { x_size }
-    , y_size { y_size }
-    , color_max { color_max }
-{
-}
+namespace {
 
-Matrix::Matrix()
-    : Matrix {
-        nullptr,
-        nullptr,
-        nullptr,
-        0,
-        0,
-        0,
+    // Every plane block is Matrix::alignment aligned, pooled or not
+    unsigned char* allocate(size_t size)
+    {
+        return static_cast<unsigned char*>(::operator new[](size, std::align_val_t { Matrix::alignment }));
     }
-{
+
+    void deallocate(unsigned char* block)
+    {
+        ::operator delete[](block, std::align_val_t { Matrix::alignment });
+    }
+
 }
 
-Matrix::Matrix(unsigned dimension)
-    : R { new unsigned char[dimension * dimension] }
-    , G { new unsigned char[dimension * dimension] }
-    , B { new unsigned char[dimension * dimension] }
-    , x_size { dimension }
-    , y_size { dimension }
-    , color_max { 0 }
+// Never destroyed: a static-duration Matrix (e.g. held by a library user)
+// may release its block after every function-local static is gone. What
+// is still cached at exit is reclaimed with the process.
+PlanePool& PlanePool::instance()
 {
+    static PlanePool* pool { new PlanePool {} };
+    return *pool;
 }
 
-Matrix::Matrix(const Matrix& other)
-    : R { new unsigned char[other.x_size * other.y_size] }
-    , G { new unsigned char[other.x_size * other.y_size] }
-    , B { new unsigned char[other.x_size * other.y_size] }
-    , x_size { other.x_size }
-    , y_size { other.y_size }
-    , color_max { other.color_max }
+unsigned char* PlanePool::acquire(size_t size)
 {
-    for (auto x { 0 }; x < x_size; x++) {
-        for (auto y { 0 }; y < y_size; y++) {
-            auto &r_val { r(x, y) }, &g_val { g(x, y) }, &b_val { b(x, y) };
-            auto other_r_val { other.r(x, y) }, other_g_val { other.g(x, y) }, other_b_val { other.b(x, y) };
-
-            r_val = other_r_val;
-            g_val = other_g_val;
-            b_val = other_b_val;
+    {
+        std::lock_guard<std::mutex> guard { lock };
+        auto it { free_blocks.find(size) };
+
+        if (it != free_blocks.end()) {
+            auto block { it->second };
+            free_blocks.erase(it);
+            cached_bytes -= size;
+            return block;
         }
     }
+
+    return allocate(size);
 }
 
-Matrix& Matrix::operator=(const Matrix other)
+// Blocks must come from acquire().
+void PlanePool::release(unsigned char* block, size_t size)
 {
-    if (this == &other) {
-        return *this;
-    }
-
-    this->~Matrix();
+    {
+        std::lock_guard<std::mutex> guard { lock };
 
-    R = new unsigned char[other.x_size * other.y_size];
-    G = new unsigned char[other.x_size * other.y_size];
-    B = new unsigned char[other.x_size * other.y_size];
-
-    x_size = other.x_size;
-    y_size = other.y_size;
-    color_max = other.color_max;
-
-    for (auto x { 0 }; x < x_size; x++) {
-        for (auto y { 0 }; y < y_size; y++) {
-            auto &r_val { r(x, y) }, &g_val { g(x, y) }, &b_val { b(x, y) };
-            auto other_r_val { other.r(x, y) }, other_g_val { other.g(x, y) }, other_b_val { other.b(x, y) };
-
-            r_val = other_r_val;
-            g_val = other_g_val;
-            b_val = other_b_val;
+        if (cached_bytes + size <= limit_bytes) {
+            free_blocks.emplace(size, block);
+            cached_bytes += size;
+            return;
         }
     }
 
-    return *this;
+    deallocate(block);
 }
 
-Matrix::~Matrix()
+void PlanePool::set_limit(size_t bytes)
 {
-    if (R) {
-        delete[] R;
-        R = nullptr;
-    }
-    if (G) {
-        delete[] G;
-        G = nullptr;
-    }
-    if (B) {
-        delete[] B;
-        B = nullptr;
-    }
+    std::lock_guard<std::mutex> guard { lock };
+    limit_bytes = bytes;
 
-    x_size = y_size = color_max = 0;
+    while (cached_bytes > limit_bytes && !free_blocks.empty()) {
+        auto it { std::prev(free_blocks.end()) };
+        cached_bytes -= it->first;
+        deallocate(it->second);
+        free_blocks.erase(it);
+    }
 }
 
-unsigned Matrix::get_x_size() const
+void PlanePool::trim()
 {
-    return x_size;
+    std::lock_guard<std::mutex> guard { lock };
+
+    for (auto& [size, block] : free_blocks) {
+        deallocate(block);
+    }
+
+    free_blocks.clear();
+    cached_bytes = 0;
 }
 
-unsigned Matrix::get_y_size() const
+PlanePool::~PlanePool()
 {
-    return y_size;
+    trim();
 }
 
-unsigned Matrix::get_color_max() const
-{
-    return color_max;
+namespace {
+
+    size_t round_up(size_t n, size_t to) { return (n + to - 1) / to * to; }
+
 }
 
-unsigned char const* Matrix::get_R() const
+Matrix::Matrix()
+    : block { nullptr }
+    , block_size { 0 }
+    , R { nullptr }
+    , G { nullptr }
+    , B { nullptr }
+    , row_stride { 0 }
+    , x_size { 0 }
+    , y_size { 0 }
+    , color_max { 0 }
 {
-    return R;
 }
 
-unsigned char const* Matrix::get_G() const
+Matrix::Matrix(unsigned dimension)
+    : Matrix { dimension, dimension, 0 }
 {
-    return G;
 }
 
-unsigned char const* Matrix::get_B() const
+// Uninitialized pixels of the given size, e.g. as a destination buffer.
+Matrix::Matrix(unsigned x_size, unsigned y_size, unsigned color_max)
+    : Matrix {}
 {
-    return B;
+    this->x_size = x_size;
+    this->y_size = y_size;
+    this->color_max = color_max;
+
+    if (x_size == 0 || y_size == 0) {
+        return;
+    }
+
+    row_stride = round_up(x_size, alignment);
+    auto plane { row_stride * y_size };
+
+    block_size = 3 * plane;
+    block = PlanePool::instance().acquire(block_size);
+
+    R = block;
+    G = block + plane;
+    B = block + 2 * plane;
 }
 
-unsigned char Matrix::r(unsigned x, unsigned y) const
+Matrix::Matrix(const Matrix& other)
+    : Matrix { other.x_size, other.y_size, other.color_max }
 {
-    return R[y * x_size + x];
+    // Same layout, so one copy takes every plane
+    if (block) {
+        std::copy_n(other.block, block_size, block);
+    }
 }
 
-unsigned char Matrix::g(unsigned x, unsigned y) const
+Matrix::Matrix(Matrix&& other) noexcept
+    : block { std::exchange(other.block, nullptr) }
+    , block_size { std::exchange(other.block_size, 0) }
+    , R { std::exchange(other.R, nullptr) }
+    , G { std::exchange(other.G, nullptr) }
+    , B { std::exchange(other.B, nullptr) }
+    , row_stride { std::exchange(other.row_stride, 0) }
+    , x_size { std::exchange(other.x_size, 0) }
+    , y_size { std::exchange(other.y_size, 0) }
+    , color_max { std::exchange(other.color_max, 0) }
 {
-    return G[y * x_size + x];
 }
 
-unsigned char Matrix::b(unsigned x, unsigned y) const
+Matrix& Matrix::operator=(const Matrix& other)
 {
-    return B[y * x_size + x];
+    if (this == &other) {
+        return *this;
+    }
+
+    return *this = Matrix { other };
 }
 
-unsigned char& Matrix::r(unsigned x, unsigned y)
+Matrix& Matrix::operator=(Matrix&& other) noexcept
 {
-    return R[y * x_size + x];
+    if (this == &other) {
+        return *this;
+    }
+
+    this->~Matrix();
+
+    block = std::exchange(other.block, nullptr);
+    block_size = std::exchange(other.block_size, 0);
+    R = std::exchange(other.R, nullptr);
+    G = std::exchange(other.G, nullptr);
+    B = std::exchange(other.B, nullptr);
+    row_stride = std::exchange(other.row_stride, 0);
+
+    x_size = std::exchange(other.x_size, 0);
+    y_size = std::exchange(other.y_size, 0);
+    color_max = std::exchange(other.color_max, 0);
+
+    return *this;
 }
 
-unsigned char& Matrix::g(unsigned x, unsigned y)
+Matrix::~Matrix()
 {
-    return G[y * x_size + x];
+    if (block) {
+        PlanePool::instance().release(block, block_size);
+    }
+
+    block = R = G = B = nullptr;
+    block_size = row_stride = 0;
+    x_size = y_size = color_max = 0;
 }
 
-unsigned char& Matrix::b(unsigned x, unsigned y)
+void Matrix::resize_like(const Matrix& other)
 {
-    return B[y * x_size + x];
+    if (this == &other) {
+        return;
+    }
+
+    if (x_size != other.x_size || y_size != other.y_size) {
+        *this = Matrix { other.x_size, other.y_size, other.color_max };
+    }
+
+    color_max = other.color_max;
 }
@@ -2,16 +2,48 @@
 Author: David Holmqvist <daae19@student.bth.se>
 */
 
+#include <cstddef>
 #include <iostream>
+#include <map>
+#include <mutex>
 
 #if !defined(MATRIX_HPP)
 #define MATRIX_HPP
 
+// Process-wide free list of image blocks, bucketed by exact size.
+// Matrix storage is acquired from and released back to it, so scratch and
+// destination images of the same shape are recycled across blur calls
+// instead of being re-allocated and page-faulted in again.
+class PlanePool {
+private:
+    std::mutex lock;
+    std::multimap<size_t, unsigned char*> free_blocks;
+    size_t cached_bytes { 0 };
+    size_t limit_bytes { size_t { 256 } << 20 };
+
+public:
+    static PlanePool& instance();
+
+    unsigned char* acquire(size_t size);
+    void release(unsigned char* block, size_t size);
+
+    void set_limit(size_t bytes);
+    void trim();
+    ~PlanePool();
+};
+
+// One allocation per image (from PlanePool) holding the R, G and B planes
+// back to back. Each plane is y_size rows of stride() bytes, x_size pixels
+// then padding up to the next multiple of `alignment`, so every row starts
+// on an `alignment` boundary. The padding is never read as pixels.
 class Matrix {
 private:
-    unsigned char* R;
+    unsigned char* block;   // nullptr for an empty matrix
+    size_t block_size;
+    unsigned char* R;       // pixel (0, 0) of each plane
     unsigned char* G;
     unsigned char* B;
+    size_t row_stride;
 
     unsigned x_size;
     unsigned y_size;
@@ -20,25 +52,47 @@ private:
 public:
     Matrix();
     Matrix(unsigned dimension);
+    // Uninitialized pixels
+    Matrix(unsigned x_size, unsigned y_size, unsigned color_max);
     Matrix(const Matrix& other);
-    Matrix(unsigned char* R, unsigned char* G, unsigned char* B, unsigned x_size, unsigned y_size, unsigned color_max);
-    Matrix& operator=(const Matrix other);
+    Matrix(Matrix&& other) noexcept;
+    Matrix& operator=(const Matrix& other);
+    Matrix& operator=(Matrix&& other) noexcept;
     ~Matrix();
 
-    unsigned get_x_size() const;
-    unsigned get_y_size() const;
-    unsigned get_color_max() const;
+    // Gives this matrix other's shape and color_max, reallocating only if the
+    // shape differs. Pixel contents are unspecified afterwards. No-op on self.
+    void resize_like(const Matrix& other);
+
+    unsigned get_x_size() const { return x_size; }
+    unsigned get_y_size() const { return y_size; }
+    unsigned get_color_max() const { return color_max; }
+
+    unsigned char const* get_R() const { return R; }
+    unsigned char const* get_G() const { return G; }
+    unsigned char const* get_B() const { return B; }
+
+    // Raw access for the kernels. Planes are row-major with rows stride()
+    // bytes apart (stride() >= x_size, a multiple of `alignment`) and every
+    // row starts on an `alignment` boundary (one AVX-512 vector).
+    // Kernels address pixels only through these, never as y * x_size.
+    static constexpr size_t alignment { 64 };
+
+    size_t stride() const { return row_stride; }
+
+    unsigned char const* plane(int c) const { return c == 0 ? R : c == 1 ? G : B; }
+    unsigned char* plane(int c) { return c == 0 ? R : c == 1 ? G : B; }
 
-    unsigned char const* get_R() const;
-    unsigned char const* get_G() const;
-    unsigned char const* get_B() const;
+    // Row y of plane c (0 R, 1 G, 2 B); x_size pixels are valid
+    unsigned char const* row(int c, unsigned y) const { return plane(c) + y * stride(); }
+    unsigned char* row(int c, unsigned y) { return plane(c) + y * stride(); }
 
-    unsigned char r(unsigned x, unsigned y) const;
-    unsigned char g(unsigned x, unsigned y) const;
-    unsigned char b(unsigned x, unsigned y) const;
-    unsigned char& r(unsigned x, unsigned y);
-    unsigned char& g(unsigned x, unsigned y);
-    unsigned char& b(unsigned x, unsigned y);
+    unsigned char r(unsigned x, unsigned y) const { return R[y * stride() + x]; }
+    unsigned char g(unsigned x, unsigned y) const { return G[y * stride() + x]; }
+    unsigned char b(unsigned x, unsigned y) const { return B[y * stride() + x]; }
+    unsigned char& r(unsigned x, unsigned y) { return R[y * stride() + x]; }
+    unsigned char& g(unsigned x, unsigned y) { return G[y * stride() + x]; }
+    unsigned char& b(unsigned x, unsigned y) { return B[y * stride() + x]; }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,219 @@
+/**
+* parallel.cpp - Reusable barrier, persistent worker pool and the range
+*   fan-out used by the blur engines.
+**/
+
+#include "parallel.hpp"
+
+#include <memory>
+#include <mutex>
+
+namespace Parallel {
+
+Barrier::Barrier(int count)
+    : count { count }
+    , waiting { 0 }
+    , generation { 0 }
+{
+    pthread_mutex_init(&lock, nullptr);
+    pthread_cond_init(&turn, nullptr);
+}
+
+Barrier::~Barrier()
+{
+    pthread_cond_destroy(&turn);
+    pthread_mutex_destroy(&lock);
+}
+
+void Barrier::reset(int count)
+{
+    pthread_mutex_lock(&lock);
+    this->count = count;
+    waiting = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+void Barrier::wait()
+{
+    pthread_mutex_lock(&lock);
+    const unsigned gen { generation };
+    if (++waiting == count) {
+        waiting = 0;
+        ++generation;
+        pthread_cond_broadcast(&turn);
+    } else {
+        while (gen == generation)
+            pthread_cond_wait(&turn, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+struct Pool::Shared {
+    pthread_mutex_t lock;
+    pthread_cond_t  start;      // workers: a new job (or stop)
+    pthread_cond_t  done;       // caller: pending reached zero
+    pthread_mutex_t serial;     // one run() at a time
+
+    const std::function<void(int)>* fn { nullptr };
+    int active { 0 };           // participants of the current job
+    int pending { 0 };          // workers still inside it
+    unsigned job { 0 };
+    bool stop { false };
+
+    Barrier barrier;
+};
+
+namespace {
+
+    struct WorkerArgs {
+        Pool* pool;
+        int index;
+        unsigned job;   // last job before this worker existed
+    };
+
+}
+
+Pool::Pool(int num_threads)
+    : state { new Shared }
+{
+    if (num_threads < 1) num_threads = 1;
+    pthread_mutex_init(&state->lock, nullptr);
+    pthread_cond_init(&state->start, nullptr);
+    pthread_cond_init(&state->done, nullptr);
+    pthread_mutex_init(&state->serial, nullptr);
+
+    reserve(num_threads);
+}
+
+Pool::~Pool()
+{
+    pthread_mutex_lock(&state->lock);
+    state->stop = true;
+    pthread_cond_broadcast(&state->start);
+    pthread_mutex_unlock(&state->lock);
+    for (auto tid : tids) pthread_join(tid, nullptr);
+
+    pthread_mutex_destroy(&state->serial);
+    pthread_cond_destroy(&state->done);
+    pthread_cond_destroy(&state->start);
+    pthread_mutex_destroy(&state->lock);
+    delete state;
+}
+
+int Pool::size() const
+{
+    return static_cast<int>(tids.size()) + 1;
+}
+
+void Pool::reserve(int num_threads)
+{
+    pthread_mutex_lock(&state->serial);
+    pthread_mutex_lock(&state->lock);
+    for (int t = size(); t < num_threads; ++t) {
+        tids.emplace_back();
+        pthread_create(&tids.back(), nullptr, &Pool::worker, new WorkerArgs { this, t, state->job });
+    }
+    pthread_mutex_unlock(&state->lock);
+    pthread_mutex_unlock(&state->serial);
+}
+
+Barrier& Pool::barrier()
+{
+    return state->barrier;
+}
+
+void* Pool::worker(void* vp)
+{
+    const WorkerArgs args { *static_cast<WorkerArgs*>(vp) };
+    delete static_cast<WorkerArgs*>(vp);
+    Shared& s { *args.pool->state };
+
+    unsigned seen { args.job };
+    pthread_mutex_lock(&s.lock);
+    for (;;) {
+        while (!s.stop && s.job == seen)
+            pthread_cond_wait(&s.start, &s.lock);
+        if (s.stop) break;
+        seen = s.job;
+        if (args.index >= s.active) continue;
+
+        const auto* fn { s.fn };
+        pthread_mutex_unlock(&s.lock);
+        (*fn)(args.index);
+        pthread_mutex_lock(&s.lock);
+
+        if (--s.pending == 0)
+            pthread_cond_signal(&s.done);
+    }
+    pthread_mutex_unlock(&s.lock);
+    return nullptr;
+}
+
+void Pool::run(int n, const std::function<void(int)>& fn)
+{
+    Shared& s { *state };
+    pthread_mutex_lock(&s.serial);
+
+    if (n < 1) n = 1;
+    if (n > size()) n = size();
+    s.barrier.reset(n);
+    if (n == 1) {
+        fn(0);
+        pthread_mutex_unlock(&s.serial);
+        return;
+    }
+
+    pthread_mutex_lock(&s.lock);
+    s.fn = &fn;
+    s.active = n;
+    s.pending = n - 1;
+    ++s.job;
+    pthread_cond_broadcast(&s.start);
+    pthread_mutex_unlock(&s.lock);
+
+    fn(0);
+
+    pthread_mutex_lock(&s.lock);
+    while (s.pending > 0)
+        pthread_cond_wait(&s.done, &s.lock);
+    s.fn = nullptr;
+    pthread_mutex_unlock(&s.lock);
+    pthread_mutex_unlock(&s.serial);
+}
+
+Pool& Pool::shared(int num_threads)
+{
+    static std::mutex lock;
+    static std::unique_ptr<Pool> pool;
+
+    std::lock_guard<std::mutex> guard { lock };
+    if (!pool)
+        pool = std::make_unique<Pool>(num_threads);
+    else if (pool->size() < num_threads)
+        pool->reserve(num_threads);
+    return *pool;
+}
+
+void for_ranges(int begin, int end, int num_threads, const std::function<void(int, int)>& fn, Pool* pool)
+{
+    const int total = end - begin;
+    if (total <= 0) return;
+    if (num_threads < 1) num_threads = 1;
+    if (num_threads > total) num_threads = total;
+    if (pool && num_threads > pool->size()) num_threads = pool->size();
+
+    if (num_threads == 1) {
+        fn(begin, end);
+        return;
+    }
+
+    const int per   = total / num_threads;
+    const int extra = total % num_threads;
+
+    (pool ? *pool : Pool::shared(num_threads)).run(num_threads, [&](int t) {
+        const int lo = begin + t * per + (t < extra ? t : extra);
+        fn(lo, lo + per + (t < extra ? 1 : 0));
+    });
+}
+
+}
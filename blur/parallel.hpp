@@ -0,0 +1,76 @@
+/**
+* parallel.hpp - Small pthread helpers shared by the blur engines.
+**/
+
+#include <functional>
+#include <pthread.h>
+#include <vector>
+
+#if !defined(PARALLEL_HPP)
+#define PARALLEL_HPP
+
+namespace Parallel {
+
+// Reusable barrier: a generation counter lets the same object separate any
+// number of phases (pthread_barrier_t has no way to change its count).
+class Barrier {
+    pthread_mutex_t lock;
+    pthread_cond_t  turn;
+    int count;
+    int waiting;
+    unsigned generation;
+
+public:
+    explicit Barrier(int count = 1);
+    Barrier(const Barrier&) = delete;
+    Barrier& operator=(const Barrier&) = delete;
+    ~Barrier();
+
+    // Only while nobody is waiting
+    void reset(int count);
+    void wait();
+};
+
+// Long-lived workers. run() wakes n - 1 of them and has the calling thread
+// take part as index 0, so a call costs two condition-variable round trips
+// instead of n pthread_create/join pairs. One run() at a time per pool
+// (concurrent callers queue up); fn must not call run() on the same pool.
+class Pool {
+    struct Shared;
+    Shared* state;
+    std::vector<pthread_t> tids;
+
+    static void* worker(void* vp);
+
+public:
+    // num_threads counts the caller, so num_threads - 1 threads are started
+    explicit Pool(int num_threads);
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+    ~Pool();
+
+    int size() const;
+    // Starts more workers so that size() >= num_threads; waits for any
+    // run() in flight first
+    void reserve(int num_threads);
+
+    // fn(t) for t in [0, n), n clamped to [1, size()]; returns when all are
+    // done. barrier() is reset to n participants for the duration.
+    void run(int n, const std::function<void(int)>& fn);
+    Barrier& barrier();
+
+    // Process-wide pool with at least num_threads participants, grown in
+    // place when a caller asks for more. Used by every engine, so successive
+    // blur calls reuse the same threads.
+    static Pool& shared(int num_threads);
+};
+
+// Splits [begin, end) into num_threads contiguous ranges (as evenly as
+// possible, like blur_parallel's row stripes) and runs fn(lo, hi) for each
+// on pool (the shared pool if nullptr). Returns once every range is done.
+void for_ranges(int begin, int end, int num_threads, const std::function<void(int, int)>& fn,
+                Pool* pool = nullptr);
+
+}
+
+#endif
@@ -3,13 +3,162 @@ Author: David Holmqvist <daae19@student.bth.se>
 */
 
 #include "ppm.hpp"
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <regex>
 #include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PPM_HAVE_X86 1
+#endif
 
 namespace PPM {
 
+namespace {
+
+    // Read-only private mapping of a whole file, unmapped on scope exit.
+    struct Mapping {
+        void* addr { MAP_FAILED };
+        size_t size { 0 };
+
+        explicit Mapping(std::string const& filename)
+        {
+            auto fd { open(filename.c_str(), O_RDONLY) };
+
+            if (fd < 0) {
+                return;
+            }
+
+            struct stat st { };
+
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                size = static_cast<size_t>(st.st_size);
+                addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+            }
+
+            close(fd);
+
+            if (addr != MAP_FAILED) {
+                madvise(addr, size, MADV_SEQUENTIAL);
+            }
+        }
+
+        ~Mapping()
+        {
+            if (addr != MAP_FAILED) {
+                munmap(addr, size);
+            }
+        }
+
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+
+        char const* begin() const { return static_cast<char const*>(addr); }
+        bool ok() const { return addr != MAP_FAILED; }
+    };
+
+    void interleave_scalar(unsigned char const* R, unsigned char const* G, unsigned char const* B,
+        unsigned char* out, size_t n)
+    {
+        for (size_t i { 0 }; i < n; i++) {
+            out[3 * i] = R[i];
+            out[3 * i + 1] = G[i];
+            out[3 * i + 2] = B[i];
+        }
+    }
+
+#if defined(PPM_HAVE_X86)
+    // 16 pixels per iteration: three pshufb per 16-byte output vector. Rows are
+    // packed back to back, so out has no particular alignment.
+    __attribute__((target("ssse3"))) void interleave_ssse3(unsigned char const* R, unsigned char const* G,
+        unsigned char const* B, unsigned char* out, size_t n)
+    {
+        const __m128i r0 { _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5) };
+        const __m128i g0 { _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1) };
+        const __m128i b0 { _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1) };
+        const __m128i r1 { _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1) };
+        const __m128i g1 { _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10) };
+        const __m128i b1 { _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1) };
+        const __m128i r2 { _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1) };
+        const __m128i g2 { _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1) };
+        const __m128i b2 { _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15) };
+
+        size_t i { 0 };
+        for (; i + 16 <= n; i += 16, out += 48) {
+            auto r { _mm_loadu_si128(reinterpret_cast<__m128i const*>(R + i)) };
+            auto g { _mm_loadu_si128(reinterpret_cast<__m128i const*>(G + i)) };
+            auto b { _mm_loadu_si128(reinterpret_cast<__m128i const*>(B + i)) };
+
+            auto o0 { _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r0), _mm_shuffle_epi8(g, g0)), _mm_shuffle_epi8(b, b0)) };
+            auto o1 { _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r1), _mm_shuffle_epi8(g, g1)), _mm_shuffle_epi8(b, b1)) };
+            auto o2 { _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r2), _mm_shuffle_epi8(g, g2)), _mm_shuffle_epi8(b, b2)) };
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), o0);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), o1);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 32), o2);
+        }
+
+        interleave_scalar(R + i, G + i, B + i, out, n - i);
+    }
+#endif
+
+    void interleave(unsigned char const* R, unsigned char const* G, unsigned char const* B,
+        unsigned char* out, size_t n)
+    {
+#if defined(PPM_HAVE_X86)
+        static const bool has_ssse3 { __builtin_cpu_supports("ssse3") != 0 };
+
+        if (has_ssse3) {
+            interleave_ssse3(R, G, B, out, n);
+            return;
+        }
+#endif
+        interleave_scalar(R, G, B, out, n);
+    }
+
+    // writev() until every iovec is drained, retrying on short writes.
+    bool write_all(int fd, iovec* iov, int count)
+    {
+        while (count > 0) {
+            auto written { writev(fd, iov, count) };
+
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+
+            auto left { static_cast<size_t>(written) };
+
+            while (count > 0 && left >= iov->iov_len) {
+                left -= iov->iov_len;
+                iov++;
+                count--;
+            }
+
+            if (count > 0) {
+                iov->iov_base = static_cast<char*>(iov->iov_base) + left;
+                iov->iov_len -= left;
+            }
+        }
+
+        return true;
+    }
+
+}
+
 void Reader::fill(std::string filename)
 {
     std::ifstream f {};
@@ -75,28 +224,27 @@ unsigned Reader::get_color_max()
     }
 }
 
-std::tuple<unsigned char*, unsigned char*, unsigned char*> Reader::get_data(unsigned x_size, unsigned y_size)
+bool Reader::get_data(Matrix& m)
 {
-    auto size { x_size * y_size };
-    auto R { new char[size] }, G { new char[size] }, B { new char[size] };
-
-    for (auto i { 0 }, read { 0 }; i < size; i++, read = 0) {
-        stream.read(R + i, 1);
-        read += stream.gcount();
-        stream.read(G + i, 1);
-        read += stream.gcount();
-        stream.read(B + i, 1);
-        read += stream.gcount();
-
-        if (read != 3) {
-            delete[] R;
-            delete[] G;
-            delete[] B;
-            return { nullptr, nullptr, nullptr };
+    for (unsigned y { 0 }; y < m.get_y_size(); y++) {
+        auto R { reinterpret_cast<char*>(m.row(0, y)) }, G { reinterpret_cast<char*>(m.row(1, y)) },
+            B { reinterpret_cast<char*>(m.row(2, y)) };
+
+        for (unsigned x { 0 }, read { 0 }; x < m.get_x_size(); x++, read = 0) {
+            stream.read(R + x, 1);
+            read += stream.gcount();
+            stream.read(G + x, 1);
+            read += stream.gcount();
+            stream.read(B + x, 1);
+            read += stream.gcount();
+
+            if (read != 3) {
+                return false;
+            }
         }
     }
 
-    return { reinterpret_cast<unsigned char*>(R), reinterpret_cast<unsigned char*>(G), reinterpret_cast<unsigned char*>(B) };
+    return true;
 }
 
 Matrix Reader::operator()(std::string filename)
@@ -132,14 +280,14 @@ Matrix Reader::operator()(std::string filename)
             throw std::runtime_error { "couldn't read color max" };
         }
 
-        auto [R, G, B] { get_data(x_size, y_size) };
+        Matrix m { x_size, y_size, color_max };
 
-        if (!R || !G || !B) {
+        if (!get_data(m)) {
             throw std::runtime_error { "couldn't read image data" };
         }
 
         stream.clear();
-        return Matrix { R, G, B, x_size, y_size, color_max };
+        return m;
     } catch (std::runtime_error e) {
         error("reading", e.what());
         stream.clear();
@@ -147,12 +295,381 @@ Matrix Reader::operator()(std::string filename)
     }
 }
 
+void MappedReader::skip_whitespace()
+{
+    while (cur < end) {
+        if (*cur == '#') {
+            while (cur < end && *cur != '\n') {
+                cur++;
+            }
+        } else if (std::isspace(static_cast<unsigned char>(*cur))) {
+            cur++;
+        } else {
+            break;
+        }
+    }
+}
+
+std::string MappedReader::get_token()
+{
+    skip_whitespace();
+
+    auto start { cur };
+
+    while (cur < end && !std::isspace(static_cast<unsigned char>(*cur))) {
+        cur++;
+    }
+
+    return { start, cur };
+}
+
+unsigned MappedReader::get_number()
+{
+    skip_whitespace();
+
+    unsigned long value { 0 };
+    auto start { cur };
+
+    while (cur < end && std::isdigit(static_cast<unsigned char>(*cur)) && value <= max_pixels) {
+        value = value * 10 + (*cur++ - '0');
+    }
+
+    if (cur == start || value > max_pixels) {
+        return 0;
+    }
+
+    return static_cast<unsigned>(value);
+}
+
+Matrix MappedReader::operator()(std::string filename)
+{
+    try {
+        Mapping map { filename };
+
+        if (!map.ok()) {
+            throw std::runtime_error { "couldn't open file " + filename };
+        }
+
+        cur = map.begin();
+        end = map.begin() + map.size;
+
+        auto magic { get_token() };
+
+        if (magic != magic_number) {
+            throw std::runtime_error { "incorrect magic number: " + magic };
+        }
+
+        auto x_size { get_number() };
+        auto y_size { get_number() };
+
+        if (x_size == 0 || y_size == 0) {
+            throw std::runtime_error { "couldn't read dimensions" };
+        }
+
+        auto total_size { static_cast<unsigned long>(x_size) * y_size };
+
+        if (total_size > max_pixels) {
+            throw std::runtime_error { "image size is too big: " + std::to_string(total_size) };
+        }
+
+        auto color_max { get_number() };
+
+        if (color_max == 0) {
+            throw std::runtime_error { "couldn't read color max" };
+        }
+
+        // Exactly one whitespace byte separates the header from the payload.
+        if (cur == end || !std::isspace(static_cast<unsigned char>(*cur))) {
+            throw std::runtime_error { "couldn't read image data" };
+        }
+        cur++;
+
+        if (static_cast<unsigned long>(end - cur) < total_size * 3) {
+            throw std::runtime_error { "couldn't read image data" };
+        }
+
+        auto src { reinterpret_cast<unsigned char const*>(cur) };
+        Matrix m { x_size, y_size, color_max };
+
+        for (unsigned y { 0 }; y < y_size; y++) {
+            auto R { m.row(0, y) }, G { m.row(1, y) }, B { m.row(2, y) };
+
+            for (unsigned x { 0 }; x < x_size; x++, src += 3) {
+                R[x] = src[0];
+                G[x] = src[1];
+                B[x] = src[2];
+            }
+        }
+
+        return m;
+    } catch (const std::runtime_error& e) {
+        error("reading", e.what());
+        return Matrix {};
+    }
+}
+
+namespace {
+
+    // Header tokens out of a growing prefix of the file. Returns false from
+    // next() when the buffer ends before the token does (read more, retry).
+    struct HeaderParser {
+        std::vector<char> data {};
+        size_t pos { 0 };
+
+        bool skip_whitespace()
+        {
+            while (pos < data.size()) {
+                if (data[pos] == '#') {
+                    while (pos < data.size() && data[pos] != '\n') {
+                        pos++;
+                    }
+                } else if (std::isspace(static_cast<unsigned char>(data[pos]))) {
+                    pos++;
+                } else {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool next(std::string& token)
+        {
+            auto start { pos };
+
+            if (!skip_whitespace()) {
+                pos = start;
+                return false;
+            }
+
+            auto first { pos };
+
+            while (pos < data.size() && !std::isspace(static_cast<unsigned char>(data[pos]))) {
+                pos++;
+            }
+
+            if (pos == data.size()) {
+                pos = start;
+                return false;
+            }
+
+            token.assign(data.data() + first, pos - first);
+            return true;
+        }
+    };
+
+    unsigned to_dimension(std::string const& token, unsigned limit)
+    {
+        if (token.empty() || token.size() > 9 || token.find_first_not_of("0123456789") != std::string::npos) {
+            return 0;
+        }
+
+        auto value { std::stoul(token) };
+        return value > limit ? 0 : static_cast<unsigned>(value);
+    }
+
+    // read() until n bytes arrived or the file ended; returns bytes read
+    size_t read_full(int fd, unsigned char* out, size_t n)
+    {
+        size_t done { 0 };
+
+        while (done < n) {
+            auto got { read(fd, out + done, n - done) };
+
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got <= 0) {
+                break;
+            }
+            done += static_cast<size_t>(got);
+        }
+
+        return done;
+    }
+
+}
+
+StreamReader::~StreamReader()
+{
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+bool StreamReader::open(std::string filename)
+{
+    try {
+        fd = ::open(filename.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            throw std::runtime_error { "couldn't open file " + filename };
+        }
+
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        // Grow the prefix until magic, dimensions and color max are complete
+        HeaderParser header {};
+        std::string tokens[4] {};
+        int parsed { 0 };
+
+        while (parsed < 4) {
+            constexpr size_t chunk { 4096 };
+            auto old { header.data.size() };
+
+            if (old > (1u << 20)) {
+                throw std::runtime_error { "couldn't read header" };
+            }
+
+            header.data.resize(old + chunk);
+            auto got { read_full(fd, reinterpret_cast<unsigned char*>(header.data.data() + old), chunk) };
+            header.data.resize(old + got);
+
+            while (parsed < 4 && header.next(tokens[parsed])) {
+                parsed++;
+            }
+
+            if (got == 0 && parsed < 4) {
+                throw std::runtime_error { "couldn't read header" };
+            }
+        }
+
+        if (tokens[0] != magic_number) {
+            throw std::runtime_error { "incorrect magic number: " + tokens[0] };
+        }
+
+        x_size = to_dimension(tokens[1], max_stream_dimension);
+        y_size = to_dimension(tokens[2], max_stream_dimension);
+
+        if (x_size == 0 || y_size == 0) {
+            throw std::runtime_error { "couldn't read dimensions" };
+        }
+
+        color_max = to_dimension(tokens[3], 65535);
+
+        if (color_max == 0) {
+            throw std::runtime_error { "couldn't read color max" };
+        }
+
+        // Exactly one whitespace byte separates the header from the payload;
+        // next() stopped on it, the rest of the prefix is payload already.
+        header.pos++;
+        buffered = header.data.size() - header.pos;
+        buffer.assign(header.data.begin() + header.pos, header.data.end());
+        rows_left = y_size;
+
+        return true;
+    } catch (const std::runtime_error& e) {
+        error("reading", e.what());
+        return false;
+    }
+}
+
+bool StreamReader::read_rows(unsigned n, unsigned char* R, unsigned char* G, unsigned char* B)
+{
+    try {
+        if (n > rows_left) {
+            throw std::runtime_error { "read past the last row" };
+        }
+
+        auto bytes { static_cast<size_t>(n) * x_size * 3 };
+
+        if (buffer.size() < bytes) {
+            buffer.resize(bytes);
+        }
+
+        auto carried { std::min(buffered, bytes) };
+
+        if (read_full(fd, buffer.data() + carried, bytes - carried) != bytes - carried) {
+            throw std::runtime_error { "couldn't read image data" };
+        }
+
+        auto pixels { static_cast<size_t>(n) * x_size };
+        auto src { buffer.data() };
+
+        for (size_t i { 0 }; i < pixels; i++) {
+            R[i] = src[3 * i];
+            G[i] = src[3 * i + 1];
+            B[i] = src[3 * i + 2];
+        }
+
+        // Payload that came with the header but belongs to later rows
+        if (buffered > bytes) {
+            std::memmove(buffer.data(), buffer.data() + bytes, buffered - bytes);
+        }
+        buffered -= carried;
+        rows_left -= n;
+
+        return true;
+    } catch (const std::runtime_error& e) {
+        error("reading", e.what());
+        return false;
+    }
+}
+
+StreamWriter::~StreamWriter()
+{
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+bool StreamWriter::open(std::string filename, unsigned x_size, unsigned y_size, unsigned color_max)
+{
+    this->filename = filename;
+    this->x_size = x_size;
+    fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0) {
+        error("writing", "failed to open " + filename);
+        return false;
+    }
+
+    header = std::string { magic_number } + "\n"
+        + std::to_string(x_size) + " " + std::to_string(y_size) + "\n"
+        + std::to_string(color_max) + "\n";
+    return true;
+}
+
+bool StreamWriter::write_rows(unsigned n, const unsigned char* R, const unsigned char* G, const unsigned char* B)
+{
+    auto pixels { static_cast<size_t>(n) * x_size };
+
+    if (buffer.size() < 3 * pixels) {
+        buffer.resize(3 * pixels);
+    }
+
+    interleave(R, G, B, buffer.data(), pixels);
+
+    iovec iov[2] { { const_cast<char*>(header.data()), header.size() }, { buffer.data(), 3 * pixels } };
+    auto first { header.empty() ? &iov[1] : &iov[0] };
+
+    if (fd < 0 || !write_all(fd, first, header.empty() ? 1 : 2)) {
+        error("writing", "failed to write " + filename);
+        return false;
+    }
+
+    header.clear();
+    return true;
+}
+
+bool StreamWriter::close()
+{
+    auto ok { fd >= 0 && ::close(fd) == 0 };
+    fd = -1;
+
+    if (!ok) {
+        error("writing", "failed to write " + filename);
+    }
+
+    return ok;
+}
+
 void error(std::string op, std::string what)
 {
     std::cerr << "Encountered PPM error during " << op << ": " << what << std::endl;
 }
 
-void Writer::operator()(Matrix m, std::string filename)
+void Writer::operator()(const Matrix& m, std::string filename)
 {
     try {
         std::ofstream f {};
@@ -168,14 +685,14 @@ void Writer::operator()(Matrix m, std::string filename)
         f << m.get_x_size() << " " << m.get_y_size() << std::endl;
         f << m.get_color_max() << std::endl;
 
-        auto size { m.get_x_size() * m.get_y_size() };
-        auto R { m.get_R() }, G { m.get_G() }, B { m.get_B() };
-        auto it_R { R }, it_G { G }, it_B { B };
+        for (unsigned y { 0 }; y < m.get_y_size(); y++) {
+            auto R { m.row(0, y) }, G { m.row(1, y) }, B { m.row(2, y) };
 
-        while (it_R < R + size && it_G < G + size && it_B < B + size) {
-            f << *it_R++
-              << *it_G++
-              << *it_B++;
+            for (unsigned x { 0 }; x < m.get_x_size(); x++) {
+                f << R[x]
+                  << G[x]
+                  << B[x];
+            }
         }
 
         f.close();
@@ -184,4 +701,68 @@ void Writer::operator()(Matrix m, std::string filename)
     }
 }
 
+bool BulkWriter::operator()(const Matrix& m, std::string filename)
+{
+    try {
+        auto fd { open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) };
+
+        if (fd < 0) {
+            throw std::runtime_error { "failed to open " + filename };
+        }
+
+        auto header { std::string { magic_number } + "\n"
+            + std::to_string(m.get_x_size()) + " " + std::to_string(m.get_y_size()) + "\n"
+            + std::to_string(m.get_color_max()) + "\n" };
+
+        std::unique_ptr<unsigned char, decltype(&std::free)> block {
+            static_cast<unsigned char*>(std::aligned_alloc(64, 3 * block_pixels)), &std::free
+        };
+
+        if (!block) {
+            close(fd);
+            throw std::runtime_error { "out of memory" };
+        }
+
+        bool ok { true };
+        size_t filled { 0 };
+
+        // The header rides along with the first block in one writev().
+        iovec iov[2] { { const_cast<char*>(header.data()), header.size() }, {} };
+        auto first { &iov[0] };
+        auto count { 2 };
+
+        // Rows are packed into the block, split where a row does not fit
+        for (unsigned y { 0 }; ok && y < m.get_y_size(); y++) {
+            for (size_t x { 0 }; ok && x < m.get_x_size();) {
+                auto n { std::min<size_t>(block_pixels - filled, m.get_x_size() - x) };
+
+                interleave(m.row(0, y) + x, m.row(1, y) + x, m.row(2, y) + x, block.get() + 3 * filled, n);
+                filled += n;
+                x += n;
+
+                if (filled == block_pixels || (y + 1 == m.get_y_size() && x == m.get_x_size())) {
+                    iov[1] = { block.get(), 3 * filled };
+                    ok = write_all(fd, first, count);
+                    first = &iov[1];
+                    count = 1;
+                    filled = 0;
+                }
+            }
+        }
+
+        // Empty image: still write the header
+        if (ok && count == 2) {
+            ok = write_all(fd, first, 1);
+        }
+
+        if (close(fd) != 0 || !ok) {
+            throw std::runtime_error { "failed to write " + filename };
+        }
+        return true;
+    } catch (const std::runtime_error& e) {
+        error("writing", e.what());
+        return false;
+    }
+}
+
 }
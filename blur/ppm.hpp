@@ -6,6 +6,8 @@ Author: David Holmqvist <daae19@student.bth.se>
 #include <exception>
 #include <iostream>
 #include <sstream>
+#include <string>
+#include <vector>
 
 #if !defined(PPM_READER_HPP)
 #define PPM_READER_HPP
@@ -17,6 +19,8 @@ void error(std::string op, std::string what);
 constexpr unsigned max_dimension { 3000 };
 constexpr unsigned max_pixels { max_dimension * max_dimension };
 constexpr char const* magic_number { "P6" };
+// Streaming never holds a whole image, so it only bounds the header values
+constexpr unsigned max_stream_dimension { 1u << 20 };
 
 class Reader {
 private:
@@ -24,7 +28,7 @@ private:
 
     std::string get_magic_number();
     std::pair<unsigned, unsigned> get_dimensions();
-    std::tuple<unsigned char*, unsigned char*, unsigned char*> get_data(unsigned x_size, unsigned y_size);
+    bool get_data(Matrix& m);
     unsigned get_color_max();
     void fill(std::string filename);
 
@@ -32,9 +36,82 @@ public:
     Matrix operator()(std::string filename);
 };
 
+// Zero-copy reader: mmaps the file, parses the header in place and
+// deinterleaves the RGB payload straight into the Matrix planes in one pass.
+class MappedReader {
+private:
+    char const* cur;
+    char const* end;
+
+    void skip_whitespace();
+    std::string get_token();
+    unsigned get_number();
+
+public:
+    Matrix operator()(std::string filename);
+};
+
 class Writer {
 public:
-    void operator()(Matrix m, std::string filename);
+    void operator()(const Matrix& m, std::string filename);
+};
+
+// Reads a P6 file a band of rows at a time, deinterleaving each band into
+// caller-provided planes; memory is one band, not the image.
+class StreamReader {
+private:
+    int fd { -1 };
+    unsigned x_size { 0 }, y_size { 0 }, color_max { 0 };
+    unsigned rows_left { 0 };
+    std::vector<unsigned char> buffer {};   // one interleaved band
+    size_t buffered { 0 };                  // payload bytes already in buffer
+
+public:
+    StreamReader() = default;
+    StreamReader(const StreamReader&) = delete;
+    StreamReader& operator=(const StreamReader&) = delete;
+    ~StreamReader();
+
+    // Parses the header; false (after reporting) on failure
+    bool open(std::string filename);
+
+    unsigned get_x_size() const { return x_size; }
+    unsigned get_y_size() const { return y_size; }
+    unsigned get_color_max() const { return color_max; }
+
+    // Next n rows into R/G/B (n * x_size bytes each); false on a short file
+    bool read_rows(unsigned n, unsigned char* R, unsigned char* G, unsigned char* B);
+};
+
+// Writes a P6 file a band of rows at a time (interleaved like BulkWriter).
+class StreamWriter {
+private:
+    int fd { -1 };
+    unsigned x_size { 0 };
+    std::string filename {};
+    std::string header {};                  // rides along with the first band
+    std::vector<unsigned char> buffer {};
+
+public:
+    StreamWriter() = default;
+    StreamWriter(const StreamWriter&) = delete;
+    StreamWriter& operator=(const StreamWriter&) = delete;
+    ~StreamWriter();
+
+    bool open(std::string filename, unsigned x_size, unsigned y_size, unsigned color_max);
+    bool write_rows(unsigned n, const unsigned char* R, const unsigned char* G, const unsigned char* B);
+    // Flushes and closes; false if anything failed to reach the file
+    bool close();
+};
+
+// Re-interleaves the planes into large aligned blocks (SSSE3 shuffles when
+// available) and hands them to the kernel with a few big write/writev calls.
+// Prints the reason and returns false on failure.
+class BulkWriter {
+public:
+    static constexpr unsigned block_pixels { 1u << 18 };
+
+    bool operator()(const Matrix& m, std::string filename);
 };
 
 }
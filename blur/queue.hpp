@@ -0,0 +1,100 @@
+/**
+* queue.hpp - Bounded single-producer/single-consumer ring used between the
+*   batch pipeline stages. Lock-free on the fast path: producer and consumer
+*   each own one index and publish it with release stores. A full or empty
+*   ring makes the blocking calls retry briefly and then sleep on a
+*   condition variable, so a stage waiting out a whole blur costs no CPU;
+*   the other side only takes the lock to wake it when someone is asleep.
+**/
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#if !defined(QUEUE_HPP)
+#define QUEUE_HPP
+
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 1, "queue needs at least one slot");
+
+    // Retries before sleeping; covers a stage that is just about to publish
+    static constexpr int spin_limit { 64 };
+
+    T slots[Capacity + 1];                      // one slot stays empty
+    alignas(64) std::atomic<size_t> head { 0 }; // next to pop (consumer)
+    alignas(64) std::atomic<size_t> tail { 0 }; // next to push (producer)
+
+    // Only one side can be blocked at a time (full and empty exclude each
+    // other), so one condition variable serves both
+    std::mutex lock;
+    std::condition_variable changed;
+    std::atomic<int> sleepers { 0 };
+
+    static size_t next(size_t i) { return i == Capacity ? 0 : i + 1; }
+
+    // Called after publishing an index. The fences pair with the one in
+    // await(): either the sleeper sees the new index before waiting, or
+    // this sees the sleeper and notifies under the lock.
+    void wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> guard { lock };
+            changed.notify_one();
+        }
+    }
+
+    template <typename Ready>
+    void await(Ready&& ready)
+    {
+        for (int i { 0 }; i < spin_limit; i++) {
+            if (ready()) return;
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> guard { lock };
+        sleepers.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        changed.wait(guard, ready);
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+public:
+    bool try_push(T& value)
+    {
+        const size_t t { tail.load(std::memory_order_relaxed) };
+        if (next(t) == head.load(std::memory_order_acquire)) return false;
+        slots[t] = std::move(value);
+        tail.store(next(t), std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& out)
+    {
+        const size_t h { head.load(std::memory_order_relaxed) };
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        out = std::move(slots[h]);
+        head.store(next(h), std::memory_order_release);
+        return true;
+    }
+
+    void push(T value)
+    {
+        await([&] { return try_push(value); });
+        wake();
+    }
+
+    T pop()
+    {
+        T value {};
+        await([&] { return try_pop(value); });
+        wake();
+        return value;
+    }
+};
+
+#endif
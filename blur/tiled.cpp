@@ -0,0 +1,222 @@
+/**
+* tiled.cpp - .tiles mapping, rectangle gather/scatter and PPM converters.
+**/
+
+#include "tiled.hpp"
+#include "ppm.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace Tiled {
+
+namespace {
+
+    constexpr size_t page { 4096 };
+    constexpr size_t line { 64 };
+
+    size_t round_up(size_t n, size_t to) { return (n + to - 1) / to * to; }
+
+    size_t tile_bytes(const Header& h) { return round_up(size_t { 3 } * h.tile_x * h.tile_y, line); }
+
+    // Walks the tiles under [x0, x1) x [y0, y1), handing fn each piece as
+    // (tile plane pointer at the piece, rect-relative x, y, width, height)
+    template <typename Tile, typename Fn>
+    void for_pieces(const Header& h, unsigned x0, unsigned y0, unsigned x1, unsigned y1, Tile&& tile, Fn&& fn)
+    {
+        for (unsigned ty { y0 / h.tile_y }; ty * h.tile_y < y1; ty++) {
+            const unsigned ty0 { std::max(y0, ty * h.tile_y) }, ty1 { std::min(y1, (ty + 1) * h.tile_y) };
+            for (unsigned tx { x0 / h.tile_x }; tx * h.tile_x < x1; tx++) {
+                const unsigned tx0 { std::max(x0, tx * h.tile_x) }, tx1 { std::min(x1, (tx + 1) * h.tile_x) };
+                auto p { tile(tx, ty) + size_t { ty0 - ty * h.tile_y } * h.tile_x + (tx0 - tx * h.tile_x) };
+                fn(p, tx0 - x0, ty0 - y0, tx1 - tx0, ty1 - ty0);
+            }
+        }
+    }
+
+}
+
+Image::~Image()
+{
+    if (base)
+        munmap(base, size);
+}
+
+void Image::map(const std::string& filename, int fd, bool writable)
+{
+    struct stat st { };
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        close(fd);
+        throw std::runtime_error { filename + " is not a tiled image" };
+    }
+
+    size = static_cast<size_t>(st.st_size);
+    void* addr { mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0) };
+    close(fd);
+    if (addr == MAP_FAILED)
+        throw std::runtime_error { "cannot map " + filename };
+    base = static_cast<unsigned char*>(addr);
+
+    std::memcpy(&header, base, sizeof(Header));
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version)
+        throw std::runtime_error { filename + " is not a tiled image (bad magic or version)" };
+    if (header.x_size == 0 || header.y_size == 0 || header.x_size > max_dimension || header.y_size > max_dimension
+        || header.tile_x == 0 || header.tile_y == 0 || header.tile_x > max_tile || header.tile_y > max_tile)
+        throw std::runtime_error { filename + ": bad dimensions" };
+
+    tiles_x = (header.x_size + header.tile_x - 1) / header.tile_x;
+    tiles_y = (header.y_size + header.tile_y - 1) / header.tile_y;
+    const size_t count { size_t { tiles_x } * tiles_y };
+    if (header.index_offset % sizeof(uint64_t) != 0 || header.index_offset > size
+        || (size - header.index_offset) / sizeof(uint64_t) < count)
+        throw std::runtime_error { filename + ": truncated index" };
+
+    index = reinterpret_cast<const uint64_t*>(base + header.index_offset);
+    for (size_t i { 0 }; i < count; i++)
+        if (index[i] > size || size - index[i] < size_t { 3 } * header.tile_x * header.tile_y)
+            throw std::runtime_error { filename + ": tile " + std::to_string(i) + " lies outside the file" };
+}
+
+void Image::open(const std::string& filename, bool writable)
+{
+    const int fd { ::open(filename.c_str(), writable ? O_RDWR : O_RDONLY) };
+    if (fd < 0)
+        throw std::runtime_error { "cannot open " + filename };
+    map(filename, fd, writable);
+}
+
+void Image::create(const std::string& filename, unsigned x_size, unsigned y_size, unsigned tile, unsigned color_max)
+{
+    if (x_size == 0 || y_size == 0 || x_size > max_dimension || y_size > max_dimension || tile == 0 || tile > max_tile)
+        throw std::runtime_error { "bad tiled image dimensions" };
+
+    Header h {};
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.version = version;
+    h.x_size = x_size;
+    h.y_size = y_size;
+    h.tile_x = h.tile_y = tile;
+    h.color_max = color_max;
+    h.index_offset = sizeof(Header);
+
+    const size_t tx { (x_size + tile - 1) / tile }, ty { (y_size + tile - 1) / tile };
+    std::vector<uint64_t> offsets(tx * ty);
+    const size_t first { round_up(sizeof(Header) + offsets.size() * sizeof(uint64_t), page) };
+    for (size_t i { 0 }; i < offsets.size(); i++)
+        offsets[i] = first + i * tile_bytes(h);
+
+    const int fd { ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644) };
+    if (fd < 0)
+        throw std::runtime_error { "cannot create " + filename };
+
+    // Sparse until written: unwritten tiles read back as zeros
+    const size_t bytes { offsets.size() * sizeof(uint64_t) };
+    if (ftruncate(fd, static_cast<off_t>(first + offsets.size() * tile_bytes(h))) != 0
+        || pwrite(fd, &h, sizeof(h), 0) != static_cast<ssize_t>(sizeof(h))
+        || pwrite(fd, offsets.data(), bytes, sizeof(h)) != static_cast<ssize_t>(bytes)) {
+        close(fd);
+        throw std::runtime_error { "cannot write " + filename };
+    }
+    map(filename, fd, true);
+}
+
+const unsigned char* Image::tile(unsigned tx, unsigned ty, int c) const
+{
+    return base + index[size_t { ty } * tiles_x + tx] + size_t(c) * header.tile_x * header.tile_y;
+}
+
+unsigned char* Image::tile(unsigned tx, unsigned ty, int c)
+{
+    return base + index[size_t { ty } * tiles_x + tx] + size_t(c) * header.tile_x * header.tile_y;
+}
+
+void Image::read(int c, unsigned x0, unsigned y0, unsigned x1, unsigned y1, unsigned char* out, size_t stride) const
+{
+    const auto tile_of { [this, c](unsigned tx, unsigned ty) { return tile(tx, ty, c); } };
+    for_pieces(header, x0, y0, x1, y1, tile_of, [&](const unsigned char* p, unsigned x, unsigned y, unsigned w, unsigned h) {
+        for (unsigned r { 0 }; r < h; r++)
+            std::memcpy(out + (y + r) * stride + x, p + size_t { r } * header.tile_x, w);
+    });
+}
+
+void Image::write(int c, unsigned x0, unsigned y0, unsigned x1, unsigned y1, const unsigned char* in, size_t stride)
+{
+    const auto tile_of { [this, c](unsigned tx, unsigned ty) { return tile(tx, ty, c); } };
+    for_pieces(header, x0, y0, x1, y1, tile_of, [&](unsigned char* p, unsigned x, unsigned y, unsigned w, unsigned h) {
+        for (unsigned r { 0 }; r < h; r++)
+            std::memcpy(p + size_t { r } * header.tile_x, in + (y + r) * stride + x, w);
+    });
+}
+
+bool is_tiled(const std::string& path)
+{
+    const std::string ext { ".tiles" };
+    return path.size() >= ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+bool from_ppm(const std::string& ppm, const std::string& tiled, unsigned tile)
+{
+    PPM::StreamReader reader {};
+    if (!reader.open(ppm))
+        return false;
+
+    try {
+        Image image {};
+        image.create(tiled, reader.get_x_size(), reader.get_y_size(), tile, reader.get_color_max());
+
+        const unsigned W { image.get_x_size() }, H { image.get_y_size() };
+        std::vector<unsigned char> planes[3];
+        for (auto& p : planes)
+            p.resize(size_t { W } * tile);
+
+        for (unsigned y { 0 }; y < H; y += tile) {
+            const unsigned n { std::min(tile, H - y) };
+            if (!reader.read_rows(n, planes[0].data(), planes[1].data(), planes[2].data()))
+                return false;
+            for (int c { 0 }; c < 3; c++)
+                image.write(c, 0, y, W, y + n, planes[c].data(), W);
+        }
+        return true;
+    } catch (const std::runtime_error& e) {
+        std::cerr << "tiled: " << e.what() << "\n";
+        return false;
+    }
+}
+
+bool to_ppm(const std::string& tiled, const std::string& ppm)
+{
+    try {
+        Image image {};
+        image.open(tiled);
+
+        PPM::StreamWriter writer {};
+        const unsigned W { image.get_x_size() }, H { image.get_y_size() }, band { image.get_tile_y() };
+        if (!writer.open(ppm, W, H, image.get_color_max()))
+            return false;
+
+        std::vector<unsigned char> planes[3];
+        for (auto& p : planes)
+            p.resize(size_t { W } * band);
+
+        for (unsigned y { 0 }; y < H; y += band) {
+            const unsigned n { std::min(band, H - y) };
+            for (int c { 0 }; c < 3; c++)
+                image.read(c, 0, y, W, y + n, planes[c].data(), W);
+            if (!writer.write_rows(n, planes[0].data(), planes[1].data(), planes[2].data()))
+                return false;
+        }
+        return writer.close();
+    } catch (const std::runtime_error& e) {
+        std::cerr << "tiled: " << e.what() << "\n";
+        return false;
+    }
+}
+
+}
@@ -0,0 +1,93 @@
+/**
+* tiled.hpp - Tiled raw image format (.tiles) for partial and parallel access
+*   Layout, all offsets absolute, numbers in the writer's native byte order
+*   (the header and index are mapped as-is; a file from a host of the other
+*   byte order fails the version check):
+*     Header       64 bytes (magic, version, size, tile size, color max)
+*     Index        one uint64 file offset per tile, row-major over the tiles
+*     Tiles        tile_x * tile_y bytes of R, then G, then B (planar);
+*                  edge tiles are full size, padded with zeros
+*   The first tile starts on a page boundary and every tile on a cache
+*   line, so the file is used straight from an mmap: any tile is one index
+*   lookup away and threads fetch tiles without a shared read position.
+**/
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if !defined(TILED_HPP)
+#define TILED_HPP
+
+namespace Tiled {
+
+constexpr char magic[8] { 'B', 'L', 'U', 'R', 'T', 'I', 'L', 'E' };
+constexpr uint32_t version { 1 };
+constexpr unsigned default_tile { 256 };
+constexpr unsigned max_tile { 4096 };
+// Same bound as PPM streaming; one side of the image
+constexpr unsigned max_dimension { 1u << 20 };
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t x_size, y_size;       // image
+    uint32_t tile_x, tile_y;       // tile
+    uint32_t color_max;
+    uint64_t index_offset;         // tiles_x * tiles_y uint64 offsets
+    uint8_t reserved[24];
+};
+static_assert(sizeof(Header) == 64, "the on-disk header is 64 bytes");
+
+// Shared mapping of one .tiles file, unmapped on destruction. open() and
+// create() throw std::runtime_error on a bad or unwritable file.
+class Image {
+private:
+    unsigned char* base { nullptr };
+    size_t size { 0 };
+    Header header {};
+    const uint64_t* index { nullptr };
+    unsigned tiles_x { 0 }, tiles_y { 0 };
+
+    void map(const std::string& filename, int fd, bool writable);
+
+public:
+    Image() = default;
+    Image(const Image&) = delete;
+    Image& operator=(const Image&) = delete;
+    ~Image();
+
+    void open(const std::string& filename, bool writable = false);
+    // New zero-filled file, opened for writing
+    void create(const std::string& filename, unsigned x_size, unsigned y_size, unsigned tile,
+                unsigned color_max = 255);
+
+    unsigned get_x_size() const { return header.x_size; }
+    unsigned get_y_size() const { return header.y_size; }
+    unsigned get_tile_x() const { return header.tile_x; }
+    unsigned get_tile_y() const { return header.tile_y; }
+    unsigned get_color_max() const { return header.color_max; }
+    unsigned get_tiles_x() const { return tiles_x; }
+    unsigned get_tiles_y() const { return tiles_y; }
+
+    // Plane c (0 R, 1 G, 2 B) of tile (tx, ty); rows are get_tile_x() apart
+    const unsigned char* tile(unsigned tx, unsigned ty, int c) const;
+    unsigned char* tile(unsigned tx, unsigned ty, int c);
+
+    // Plane c of the rectangle [x0, x1) x [y0, y1), gathered from / scattered
+    // to the tiles it covers; out / in rows are `stride` bytes apart
+    void read(int c, unsigned x0, unsigned y0, unsigned x1, unsigned y1, unsigned char* out, size_t stride) const;
+    void write(int c, unsigned x0, unsigned y0, unsigned x1, unsigned y1, const unsigned char* in, size_t stride);
+};
+
+// True if path names a .tiles file (by extension)
+bool is_tiled(const std::string& path);
+
+// Converters, one band of tile rows in memory at a time. Print the reason
+// and return false on failure.
+bool from_ppm(const std::string& ppm, const std::string& tiled, unsigned tile = default_tile);
+bool to_ppm(const std::string& tiled, const std::string& ppm);
+
+}
+
+#endif
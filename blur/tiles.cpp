@@ -0,0 +1,26 @@
+/**
+* tiles.cpp - PPM <-> .tiles converter; the direction follows the extensions.
+**/
+
+#include "tiled.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+int main(int argc, char const* argv[])
+{
+    if (argc < 3 || argc > 4 || Tiled::is_tiled(argv[1]) == Tiled::is_tiled(argv[2]) || (argc == 4 && Tiled::is_tiled(argv[1]))) {
+        std::cerr << "Usage: " << argv[0] << " [infile.ppm] [outfile.tiles] [tile_size]\n"
+                  << "       " << argv[0] << " [infile.tiles] [outfile.ppm]\n"
+                  << "  tile_size: square tile side in pixels (default " << Tiled::default_tile
+                  << ", at most " << Tiled::max_tile << ")\n";
+        return 1;
+    }
+
+    if (Tiled::is_tiled(argv[1]))
+        return Tiled::to_ppm(argv[1], argv[2]) ? 0 : 1;
+
+    const unsigned tile { argc == 4 ? static_cast<unsigned>(std::atoi(argv[3])) : Tiled::default_tile };
+    return Tiled::from_ppm(argv[1], argv[2], tile) ? 0 : 1;
+}
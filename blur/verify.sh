@@ -1,6 +1,6 @@
 #!/bin/bash
 
-echo "NOTE: this script relies on the binaries blur and blur_par to exist"
+echo "NOTE: this script relies on the binaries blur, blur_par, tiles and libcheck, and on openssl, to exist"
 
 status=0
 red=$(tput setaf 1)
@@ -22,4 +22,222 @@ do
     done
 done
 
-exit $status
\ No newline at end of file
+# ---- blur_par modes, each against the sequential blur of the same input ----
+# Inputs: two of the data images plus noise of degenerate shapes (one
+# column, one row, wider than im4), all blurred with radius 15.
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# noise W H NAME SEED: AES-CTR keystream, so every run sees the same pixels
+noise() {
+    { printf "P6\n%d %d\n255\n" "$1" "$2"
+      openssl enc -aes-128-ctr -nosalt -K 00000000000000000000000000001674 -iv "$(printf "%032x" "$4")" \
+          < /dev/zero 2> /dev/null | head -c $(( $1 * $2 * 3 )); } > "$tmp/$3.ppm"
+}
+noise 1 97 col_1x97 1
+noise 97 1 row_97x1 2
+noise 3500 40 wide_3500x40 3
+
+inputs="data/im1.ppm data/im2.ppm $tmp/col_1x97.ppm $tmp/row_97x1.ppm $tmp/wide_3500x40.ppm"
+for input in $inputs
+do
+    ./blur 15 "$input" "$tmp/$(basename "$input" .ppm)_seq.ppm" > /dev/null
+done
+
+# check LABEL INPUT ARGS...: blur_par 15 INPUT ... ARGS must match blur
+check() {
+    local label=$1 input=$2
+    shift 2
+    local name
+    name=$(basename "$input" .ppm)
+
+    ./blur_par 15 "$input" "$tmp/${name}_par.ppm" "$@" > /dev/null
+
+    if ! cmp -s "$tmp/${name}_seq.ppm" "$tmp/${name}_par.ppm"
+    then
+        echo "${red}Error: $label output differs from blur for $name.ppm ($*)${reset}"
+        status=1
+    fi
+
+    rm -f "$tmp/${name}_par.ppm"
+}
+
+for flags in "--fused" "--schedule=dynamic --chunk=3" "--schedule=wavefront --chunk=5" "--low-memory" \
+             "--vertical=strips" "--vertical=strips --fused" "--vertical=strips --low-memory"
+do
+    for thread in 1 3 8
+    do
+        for input in $inputs
+        do
+            check "$flags" "$input" $thread $flags
+        done
+    done
+done
+
+# Bands narrower than the halo (7 rows) and the default
+for band in 7 256
+do
+    for input in $inputs
+    do
+        check "--stream" "$input" 3 --stream=$band
+    done
+done
+for input in $inputs
+do
+    check "--stream --vertical=strips" "$input" 3 --stream=7 --vertical=strips
+done
+
+# --stream onto its own input must be refused, input untouched
+cp data/im1.ppm "$tmp/self.ppm"
+if ./blur_par 15 "$tmp/self.ppm" "$tmp/self.ppm" 3 --stream 2> /dev/null || ! cmp -s "$tmp/self.ppm" data/im1.ppm
+then
+    echo "${red}Error: --stream onto its own input was not refused${reset}"
+    status=1
+fi
+rm -f "$tmp/self.ppm"
+
+# .tiles round trip: convert, blur tile to tile, convert back. 32-pixel
+# tiles are narrower than the halo, 256 is the default.
+for tile in 32 256
+do
+    for input in $inputs
+    do
+        name=$(basename "$input" .ppm)
+        ./tiles "$input" "$tmp/$name.tiles" $tile \
+            && ./blur_par 15 "$tmp/$name.tiles" "$tmp/${name}_par.tiles" 3 \
+            && ./tiles "$tmp/${name}_par.tiles" "$tmp/${name}_par.ppm"
+
+        if ! cmp -s "$tmp/${name}_seq.ppm" "$tmp/${name}_par.ppm"
+        then
+            echo "${red}Error: .tiles output differs from blur for $name.ppm (tile $tile)${reset}"
+            status=1
+        fi
+
+        rm -f "$tmp/$name.tiles" "$tmp/${name}_par.tiles" "$tmp/${name}_par.ppm"
+    done
+done
+
+# Blurring a .tiles file onto itself must be refused, input untouched
+./tiles data/im1.ppm "$tmp/self.tiles" && cp "$tmp/self.tiles" "$tmp/self_orig.tiles"
+if ./blur_par 15 "$tmp/self.tiles" "$tmp/self.tiles" 3 2> /dev/null || ! cmp -s "$tmp/self.tiles" "$tmp/self_orig.tiles"
+then
+    echo "${red}Error: blurring a .tiles file onto itself was not refused${reset}"
+    status=1
+fi
+rm -f "$tmp/self.tiles" "$tmp/self_orig.tiles"
+
+# Four regions meeting at (37, 23) and running past the image cover all of
+# it, so the result must be the full blur, halos across the seams included
+quadrants="--roi=0,0,37,23 --roi=37,0,100000,23 --roi=0,23,37,100000 --roi=37,23,100000,100000"
+for thread in 1 3 8
+do
+    for input in $inputs
+    do
+        check "--roi" "$input" $thread $quadrants
+    done
+done
+
+# ISAs the CPU lacks fall back to the best one it has. --generic keeps the
+# fixed-radius kernels out, so both kernel families are covered.
+for isa in scalar sse4.1 avx2 avx512
+do
+    for input in $inputs
+    do
+        check "--isa=$isa" "$input" 3 --isa=$isa
+        check "--isa=$isa --generic" "$input" 3 --isa=$isa --generic
+    done
+done
+
+# A radius list without --cascade blurs each radius from the input, so every
+# _r<radius> output must match a single-radius run
+for input in $inputs
+do
+    name=$(basename "$input" .ppm)
+    ./blur 5 "$input" "$tmp/${name}_seq5.ppm" > /dev/null
+    ./blur_par 5,15 "$input" "$tmp/${name}.ppm" 3 > /dev/null
+
+    if ! cmp -s "$tmp/${name}_seq5.ppm" "$tmp/${name}_r5.ppm" || ! cmp -s "$tmp/${name}_seq.ppm" "$tmp/${name}_r15.ppm"
+    then
+        echo "${red}Error: radius list 5,15 differs from single-radius blurs for $name.ppm${reset}"
+        status=1
+    fi
+
+    rm -f "$tmp/${name}_seq5.ppm" "$tmp/${name}_r5.ppm" "$tmp/${name}_r15.ppm"
+done
+
+# --cascade is approximate; --verify exits non-zero below its PSNR bound
+for input in $inputs
+do
+    name=$(basename "$input" .ppm)
+    if ! ./blur_par 5,15,30 "$input" "$tmp/${name}.ppm" 3 --cascade --verify > /dev/null 2>&1
+    then
+        echo "${red}Error: --cascade --verify failed for $name.ppm${reset}"
+        status=1
+    fi
+
+    rm -f "$tmp/${name}_r5.ppm" "$tmp/${name}_r15.ppm" "$tmp/${name}_r30.ppm"
+done
+
+# Approximate engines: --verify exits non-zero when the result falls
+# outside the engine's PSNR / max abs error bounds
+for engine in box iir fixed
+do
+    for image in data/*.ppm
+    do
+        if ! ./blur_par 15 "$image" "$tmp/engine.ppm" 3 --engine=$engine --verify 2> /dev/null
+        then
+            echo "${red}Error: --engine=$engine --verify failed for $(basename "$image")${reset}"
+            status=1
+        fi
+    done
+done
+rm -f "$tmp/engine.ppm"
+
+# --batch over a directory: every data/ image, under its own name
+for image in data/*.ppm
+do
+    ./blur 15 "$image" "$tmp/ref_$(basename "$image")" > /dev/null
+done
+./blur_par 15 data "$tmp/batch_dir" 3 --batch 2> /dev/null
+for image in data/*.ppm
+do
+    if ! cmp -s "$tmp/ref_$(basename "$image")" "$tmp/batch_dir/$(basename "$image")"
+    then
+        echo "${red}Error: --batch over data/ differs from blur for $(basename "$image")${reset}"
+        status=1
+    fi
+done
+rm -rf "$tmp"/ref_*.ppm "$tmp/batch_dir"
+
+# --batch over a manifest: a comment, a blank line, an output in a
+# subdirectory and default outputs
+{ printf "# radius 15\ndata/im1.ppm nested/im1.ppm\n\n"; printf "%s\n" $inputs; } > "$tmp/manifest"
+./blur_par 15 "$tmp/manifest" "$tmp/batch_list" 3 --batch 2> /dev/null
+for output in nested/im1.ppm $(for input in $inputs; do basename "$input"; done)
+do
+    if ! cmp -s "$tmp/$(basename "$output" .ppm)_seq.ppm" "$tmp/batch_list/$output"
+    then
+        echo "${red}Error: --batch manifest output $output differs from blur${reset}"
+        status=1
+    fi
+done
+rm -rf "$tmp/manifest" "$tmp/batch_list"
+
+# A missing input must fail the run, the other images still get written
+printf "%s\n" "$tmp/missing.ppm" data/im1.ppm > "$tmp/manifest"
+if ./blur_par 15 "$tmp/manifest" "$tmp/batch_list" 3 --batch 2> /dev/null \
+    || ! cmp -s "$tmp/im1_seq.ppm" "$tmp/batch_list/im1.ppm"
+then
+    echo "${red}Error: --batch with a missing input did not fail, or dropped the rest${reset}"
+    status=1
+fi
+rm -rf "$tmp/manifest" "$tmp/batch_list"
+
+# Library entry points blur_par does not reach, against blur_parallel
+if ! ./libcheck "data/im1.ppm"
+then
+    echo "${red}Error: libblur.a entry points disagree with blur_parallel${reset}"
+    status=1
+fi
+
+exit $status